@@ -0,0 +1,70 @@
+#ifndef ASYNC_SOCKET_H
+#define ASYNC_SOCKET_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include "socket.h"
+#include "poller.h"
+#include "tools.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdexcept>
+#include <deque>
+#include <vector>
+
+/// @brief Non-blocking writer over a connected Socket. What can't be sent
+///  right away is kept in a bounded queue, and sent by flush() when the socket
+///  is writable, so a slow peer never blocks the thread. Buffers given with
+///  write_ref() are queued without copying them. The queue reports
+///  backpressure with callbacks: "on_high" when it reaches the high watermark,
+///  and "on_low" when it drains back to the low one. The Socket must outlive
+///  this object, and is set in non-blocking mode.
+class AsyncSocket {
+public:
+    typedef void (*WatermarkCallback)(AsyncSocket& socket, void* args);
+    typedef void (*SentCallback)(const void* data, bool sent, void* args);
+
+private:
+    struct Chunk {
+        const void* msg;    // As given to write() or write_ref().
+        const char* data;   // First byte queued, copied or in "msg".
+        int len;
+        int offset;         // Bytes already sent.
+        bool owned;         // Copied by write(), deleted when sent.
+        SentCallback on_sent;
+        void* args;
+    };
+    Socket& socket;
+    std::deque<Chunk> queue;
+    std::vector<struct iovec> iov;
+    int pending;
+    int high_watermark, low_watermark, max_pending;
+    bool high;
+    int error;
+    WatermarkCallback on_high, on_low;
+    void* watermark_args;
+    Poller* poller;
+    uint32_t events;
+    bool writing;       // Waiting for "EPOLLOUT" in the poller.
+    int enqueue(const void* data, int len, bool copy, SentCallback on_sent, void* args);
+    void release(Chunk& chunk, bool sent);
+    void want_write(bool enable);
+
+public:
+    AsyncSocket(Socket& socket, int high_watermark=262144, int low_watermark=65536, int max_pending=4194304);
+    ~AsyncSocket();
+
+    int write(const void* msg, int len);
+    int write_ref(const void* msg, int len, SentCallback on_sent=NULL, void* args=NULL);
+    int flush(void);
+    void set_watermark_callbacks(WatermarkCallback on_high, WatermarkCallback on_low, void* args=NULL);
+    void set_poller(Poller* poller, uint32_t events=EPOLLIN);
+
+    int get_pending(void) const;
+    bool is_high(void) const;
+    Socket& get_socket(void);
+};
+
+#endif // ASYNC_SOCKET_H
@@ -0,0 +1,283 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include "socket.h"
+#include "socket_stream.h"
+#include "tools.h"
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// @brief Encodes and decodes the messages of a Channel. Trivially copyable
+///  types are copied as they are, in host byte order; lengths and counts are
+///  in network byte order. For any other type, specialize it as
+///  "template <> struct Serializer<my_type>" with the same three functions:
+///  * size(value); Bytes needed to encode "value".
+///  * encode(value, buffer); Writes "size(value)" bytes in "buffer".
+///  * decode(value, buffer, len); Loads "value" from "len" bytes. Returns
+///  "false" if they don't hold a valid encoding.
+template <class T, bool trivial = std::is_trivially_copyable<T>::value>
+struct Serializer;
+
+template <class T>
+struct Serializer<T, true> {
+    static size_t size(const T& value) {
+        return sizeof(T);
+    }
+    static void encode(const T& value, char* buffer) {
+        memcpy(buffer, &value, sizeof(T));
+    }
+    static bool decode(T& value, const char* buffer, size_t len) {
+        if (len != sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, buffer, sizeof(T));
+        return true;
+    }
+};
+
+template <>
+struct Serializer<std::string, false> {
+    static size_t size(const std::string& value) {
+        return value.size();
+    }
+    static void encode(const std::string& value, char* buffer) {
+        memcpy(buffer, value.data(), value.size());
+    }
+    static bool decode(std::string& value, const char* buffer, size_t len) {
+        value.assign(buffer, len);
+        return true;
+    }
+};
+
+/// @brief Vectors are encoded as the amount of elements, followed by the
+///  elements. Elements of a trivially copyable type are copied in one block;
+///  any other element is prefixed with its length. The amount and the lengths
+///  are in network byte order, as the length of the frame.
+template <class U>
+struct Serializer<std::vector<U>, false> {
+    static size_t size(const std::vector<U>& value) {
+        size_t len = sizeof(uint32_t);
+        if (std::is_trivially_copyable<U>::value) {
+            return len + value.size() * sizeof(U);
+        }
+        for (size_t i = 0; i < value.size(); i++) {
+            len += sizeof(uint32_t) + Serializer<U>::size(value[i]);
+        }
+        return len;
+    }
+    static void encode(const std::vector<U>& value, char* buffer) {
+        uint32_t len = htonl(value.size());
+        memcpy(buffer, &len, sizeof(len));
+        buffer += sizeof(len);
+        if (std::is_trivially_copyable<U>::value) {
+            memcpy(buffer, (const void*) value.data(), value.size() * sizeof(U));
+            return;
+        }
+        for (size_t i = 0; i < value.size(); i++) {
+            len = htonl(Serializer<U>::size(value[i]));
+            memcpy(buffer, &len, sizeof(len));
+            Serializer<U>::encode(value[i], buffer + sizeof(len));
+            buffer += sizeof(len) + ntohl(len);
+        }
+    }
+    static bool decode(std::vector<U>& value, const char* buffer, size_t len) {
+        uint32_t count, element_len;
+        if (len < sizeof(count)) {
+            return false;
+        }
+        memcpy(&count, buffer, sizeof(count));
+        count = ntohl(count);
+        buffer += sizeof(count);
+        len -= sizeof(count);
+        if (std::is_trivially_copyable<U>::value) {
+            if (len % sizeof(U) != 0 || len / sizeof(U) != count) {
+                return false;
+            }
+            value.resize(count);
+            memcpy((void*) value.data(), buffer, len);
+            return true;
+        }
+        // Each element needs at least its length, so a forged count can't
+        // make it allocate more than the frame can hold.
+        if (count > len / sizeof(element_len)) {
+            return false;
+        }
+        value.clear();
+        value.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            U element;
+            if (len < sizeof(element_len)) {
+                return false;
+            }
+            memcpy(&element_len, buffer, sizeof(element_len));
+            element_len = ntohl(element_len);
+            buffer += sizeof(element_len);
+            len -= sizeof(element_len);
+            if (len < element_len || !Serializer<U>::decode(element, buffer, element_len)) {
+                return false;
+            }
+            value.push_back(element);
+            buffer += element_len;
+            len -= element_len;
+        }
+        return len == 0;
+    }
+};
+
+/// @brief Typed messages over a connected Socket. Each message is sent as a
+///  frame prefixed with its length, through a buffered SocketStream, so a
+///  batch of messages goes out with a single flush.
+/// @tparam T Type of the messages. Trivially copyable types are sent as they
+///  are, with no encoding; any other type needs a Serializer.
+template <class T>
+class Channel {
+private:
+    SocketStream stream;
+    std::vector<char> frame;
+    size_t max_len;
+    int write_one(const T& msg, std::true_type trivial);
+    int write_one(const T& msg, std::false_type trivial);
+    int read_one(T& msg, std::true_type trivial);
+    int read_one(T& msg, std::false_type trivial);
+
+public:
+    Channel(Socket& socket, size_t max_len=65536, int buffer_size=65536);
+    int write(const T& msg, bool flush=true);
+    int write_batch(const T* msgs, int count);
+    int read(T& msg);
+    int flush(void);
+    SocketStream& get_stream(void);
+    Channel& operator<<(const T& msg);
+    Channel& operator>>(T& msg);
+};
+
+/******************************************************************************
+ * Template functions
+******************************************************************************/
+
+/// @brief Creates a channel over a connected socket. Both ends must use the
+///  same type.
+/// @param socket Connected socket. Must outlive the channel.
+/// @param max_len Longest encoded message accepted by read().
+/// @param buffer_size Size of the read and write buffers.
+/// @return Might throw std::runtime_error on error.
+template <class T>
+Channel<T>::Channel(Socket& socket, size_t max_len, int buffer_size):
+    stream(socket, buffer_size, buffer_size), max_len(max_len) {}
+
+/// @brief Sends a message.
+/// @param msg Message to send.
+/// @param flush If "false", the message stays in the write buffer until the
+///  buffer fills up or flush() is called ("true" by default).
+/// @return "0" on success, "-1" on error.
+template <class T>
+int Channel<T>::write(const T& msg, bool flush) {
+    if (this->write_one(msg, std::is_trivially_copyable<T>()) == -1) {
+        return -1;
+    }
+    return (flush) ? this->flush() : 0;
+}
+
+/// @brief Sends "count" messages, with a single flush at the end.
+/// @return "0" on success, "-1" on error.
+template <class T>
+int Channel<T>::write_batch(const T* msgs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (this->write_one(msgs[i], std::is_trivially_copyable<T>()) == -1) {
+            return -1;
+        }
+    }
+    return this->flush();
+}
+
+/// @brief Reads a message, blocking until a whole one arrives.
+/// @param msg Where the message will be stored.
+/// @return "0" on success, "-1" on error. "-1" with errno "ENOTCONN" if the
+///  connection was closed, or "EMSGSIZE" if the message is longer than
+///  "max_len". "EBADMSG" if the message couldn't be decoded.
+template <class T>
+int Channel<T>::read(T& msg) {
+    return this->read_one(msg, std::is_trivially_copyable<T>());
+}
+
+/// @brief Sends every message written and not sent yet.
+/// @return "0" on success, "-1" on error.
+template <class T>
+int Channel<T>::flush(void) {
+    return this->stream.flush();
+}
+
+/// @brief Return the stream under the channel.
+template <class T>
+SocketStream& Channel<T>::get_stream(void) {
+    return this->stream;
+}
+
+/// @brief Trivially copyable messages are copied once, to the write buffer.
+template <class T>
+int Channel<T>::write_one(const T& msg, std::true_type trivial) {
+    return (this->stream.write_frame(&msg, sizeof(T)) == -1) ? -1 : 0;
+}
+
+template <class T>
+int Channel<T>::write_one(const T& msg, std::false_type trivial) {
+    size_t len = Serializer<T>::size(msg);
+    this->frame.resize(len);
+    Serializer<T>::encode(msg, this->frame.data());
+    return (this->stream.write_frame(this->frame.data(), len) == -1) ? -1 : 0;
+}
+
+template <class T>
+int Channel<T>::read_one(T& msg, std::true_type trivial) {
+    int len = this->stream.read_frame(&msg, sizeof(T));
+    if (len != -1 && len != (int) sizeof(T)) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return (len == -1) ? -1 : 0;
+}
+
+template <class T>
+int Channel<T>::read_one(T& msg, std::false_type trivial) {
+    int len;
+    this->frame.resize(this->max_len);
+    if ( (len = this->stream.read_frame(this->frame.data(), this->max_len) ) == -1) {
+        return -1;
+    }
+    if (!Serializer<T>::decode(msg, this->frame.data(), len)) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Overloaded operators
+******************************************************************************/
+
+/// @brief Sends a message. Might throw "std::runtime_error".
+template <class T>
+Channel<T>& Channel<T>::operator<<(const T& msg) {
+    if (this->write(msg) == -1) {
+        throw(std::runtime_error("Channel::operator<<"));
+    }
+    return *this;
+}
+
+/// @brief Reads a message. Might throw "std::runtime_error".
+template <class T>
+Channel<T>& Channel<T>::operator>>(T& msg) {
+    if (this->read(msg) == -1) {
+        throw(std::runtime_error("Channel::operator>>"));
+    }
+    return *this;
+}
+
+#endif // CHANNEL_H
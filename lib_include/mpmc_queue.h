@@ -0,0 +1,459 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "shared_memory.h"
+#include "tools.h"
+#include <stdexcept>
+#include <errno.h>
+#include <unistd.h>
+#include <atomic>
+#include <type_traits>
+
+/// @brief Bounded queue of messages for any amount of producers and consumers,
+///  processes or threads of the same host, in a SharedMemory segment. Each slot
+///  has a sequence number that tells whose turn it is, so producers and
+///  consumers only compete for the next position with a compare and swap,
+///  instead of serializing on a lock. Blocking calls sleep on a futex while
+///  the queue is empty or full.
+///
+///  A slot being written or read is marked with the pid of its owner, so a
+///  process that dies in the middle only holds that slot: the rest of the
+///  queue is left intact, and recover() releases it. Blocking calls stuck
+///  behind a dead owner recover it by themselves. A message whose writer died
+///  is discarded, and one whose reader died is lost.
+/// @tparam msg_t Type of the message. It must be trivially copyable, and with
+///  the same restrictions of MsgQueue.
+template <class msg_t>
+class MpmcQueue {
+private:
+    /// @brief State of a slot: its sequence number in the low half, and the
+    ///  pid of the process using it, "0" if none, in the high half. With
+    ///  position "pos" mapped to the slot, the sequence is "pos" when it's free
+    ///  for a producer, and "pos + 1" when it holds a message.
+    struct Slot {
+        std::atomic<uint64_t> state;
+        msg_t msg;
+    };
+    /// @brief Start of the segment. Each group of fields lives in its own cache
+    ///  line. "items" and "spaces" are futex words, bumped to wake up sleeping
+    ///  consumers and producers.
+    struct Control {
+        alignas(64) std::atomic<uint32_t> tail;     // Next position to write.
+        alignas(64) std::atomic<uint32_t> head;     // Next position to read.
+        alignas(64) std::atomic<uint32_t> items;
+        std::atomic<uint32_t> consumers_waiting;
+        alignas(64) std::atomic<uint32_t> spaces;
+        std::atomic<uint32_t> producers_waiting;
+        alignas(64) uint32_t capacity;              // Power of 2.
+        std::atomic<uint32_t> ready;                // "MPMC_QUEUE_MAGIC" when set.
+    };
+    static const uint32_t MPMC_QUEUE_MAGIC = 0x4d504d43;
+    static const uint32_t DEAD_OWNER = 0xffffffff;  // Writer died, skip it.
+    static const int RECOVERY_MS = 50;
+    SharedMemory<char> shm;
+    Control* control;
+    Slot* slots;
+    uint32_t mask;
+    uint32_t pid;
+    static size_t segment_size(bool create, int capacity);
+    static uint64_t pack(uint32_t seq, uint32_t owner);
+    static int futex_wait(std::atomic<uint32_t>* addr, uint32_t value, int timeout_ms);
+    static void notify(std::atomic<uint32_t>& event, std::atomic<uint32_t>& waiting);
+    int park(std::atomic<uint32_t>& event, std::atomic<uint32_t>& waiting, bool producer, const msg_t* in, msg_t* out);
+    void recover_blocker(std::atomic<uint32_t>& position);
+
+public:
+    MpmcQueue(const char* path, int id, bool create=false, int capacity=1024);
+    bool static exists(const char* path, int id);
+    int write(const msg_t& msg, long mtype=1, int flags=0);
+    int try_write(const msg_t& msg);
+    msg_t read(int mtype=0, int* status=NULL, int flags=0);
+    int read_into(msg_t& msg, long mtype=0, int flags=0);
+    int try_read(msg_t& msg);
+    int recover(pid_t owner);
+    int get_msg_qtty(void);
+    int get_capacity(void) const;
+    bool is_empty(void);
+    bool has_msg(void);
+    MpmcQueue& operator<<(msg_t msg);
+    MpmcQueue& operator>>(msg_t& msg);
+};
+
+/******************************************************************************
+ * Template functions
+******************************************************************************/
+
+/// @brief Creates a queue, or connects to an existing one. Each process must
+///  make its own object, since it marks the slots it uses with its pid.
+/// @param path Can be any path. Identifier for the queue.
+/// @param id Can be any number. Identifier for the queue.
+/// @param create If "true", create the queue. If "false", connect to an
+///  already existing one.
+/// @param capacity Most messages the queue holds, rounded up to a power of 2,
+///  and at least 2. Only used with "create" (1024 by default).
+/// @return If error, throws an exception with std::runtime_error
+template <class msg_t>
+MpmcQueue<msg_t>::MpmcQueue(const char* path, int id, bool create, int capacity):
+    shm(path, id, segment_size(create, capacity)) {
+    static_assert(std::is_trivially_copyable<msg_t>::value, "MpmcQueue messages must be trivially copyable");
+    this->pid = (uint32_t) getpid();
+    this->control = (Control*) &this->shm[0];
+    this->slots = (Slot*) (this->control + 1);
+    if (create) {
+        this->control->capacity = (uint32_t) ((segment_size(true, capacity) - sizeof(Control)) / sizeof(Slot));
+        for (uint32_t i = 0; i < this->control->capacity; i++) {
+            this->slots[i].state.store(pack(i, 0), std::memory_order_relaxed);
+        }
+        this->control->tail.store(0, std::memory_order_relaxed);
+        this->control->head.store(0, std::memory_order_relaxed);
+        this->control->items.store(0, std::memory_order_relaxed);
+        this->control->consumers_waiting.store(0, std::memory_order_relaxed);
+        this->control->spaces.store(0, std::memory_order_relaxed);
+        this->control->producers_waiting.store(0, std::memory_order_relaxed);
+        this->control->ready.store(MPMC_QUEUE_MAGIC, std::memory_order_release);
+    } else if (this->control->ready.load(std::memory_order_acquire) != MPMC_QUEUE_MAGIC) {
+        fprintf(stderr, ERROR("Segment is not an initialized queue in MpmcQueue::MpmcQueue\n"));
+        throw(std::runtime_error("MpmcQueue"));
+    }
+    this->mask = this->control->capacity - 1;
+}
+
+/// @brief Checks if the queue already exists.
+/// @return "true" if it exists, "false" otherwise.
+template <class msg_t>
+bool MpmcQueue<msg_t>::exists(const char* path, int id) {
+    return SharedMemory<char>::exists(path, id);
+}
+
+/// @brief Writes a message in the queue, waiting while it's full.
+/// @param msg Message to be written.
+/// @param mtype Ignored, kept for compatibility with MsgQueue (default "1").
+/// @param flags "IPC_NOWAIT" to behave as try_write() ("0" by default).
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int MpmcQueue<msg_t>::write(const msg_t& msg, long mtype, int flags) {
+    if (this->try_write(msg) == 0) {
+        return 0;
+    }
+    if (flags & IPC_NOWAIT) {
+        return -1;
+    }
+    return this->park(this->control->spaces, this->control->producers_waiting, true, &msg, NULL);
+}
+
+/// @brief Writes a message in the queue without blocking.
+/// @param msg Message to be written.
+/// @return "0" on success, "-1" with errno "EAGAIN" if the queue is full.
+template <class msg_t>
+int MpmcQueue<msg_t>::try_write(const msg_t& msg) {
+    uint32_t pos = this->control->tail.load(std::memory_order_relaxed), expected;
+    for (;;) {
+        Slot& slot = this->slots[pos & this->mask];
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+        int32_t diff = (int32_t) ((uint32_t) state - pos);
+        if (diff == 0 && (state >> 32) == 0) {
+            if (slot.state.compare_exchange_weak(state, pack(pos, this->pid), std::memory_order_acquire)) {
+                expected = pos;
+                this->control->tail.compare_exchange_strong(expected, pos + 1);
+                slot.msg = msg;
+                slot.state.store(pack(pos + 1, 0), std::memory_order_seq_cst);
+                notify(this->control->items, this->control->consumers_waiting);
+                return 0;
+            }
+            continue;
+        }
+        if (diff < 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        // Already taken: help its owner, that might have died, move the tail.
+        expected = pos;
+        this->control->tail.compare_exchange_strong(expected, pos + 1);
+        pos = this->control->tail.load(std::memory_order_relaxed);
+    }
+}
+
+/// @brief Reads the first message of the queue. By default, in a blocking
+///  manner.
+/// @param mtype Must be "0": the queue is FIFO only.
+/// @param status If not NULL, it will be loaded with a "0" on success, or with
+///  the "errno" value in case of error.
+/// @param flags "IPC_NOWAIT" for a non-blocking read ("0" by default).
+/// @return The message read.
+template <class msg_t>
+msg_t MpmcQueue<msg_t>::read(int mtype, int* status, int flags) {
+    msg_t output;
+    int error_state = 0;
+    memset(&output, 0, sizeof(output));
+    if (this->read_into(output, mtype, flags) == -1) {
+        error_state = errno;
+    }
+    if (status != NULL) {
+        *status = error_state;
+    }
+    return output;
+}
+
+/// @brief Reads the first message of the queue into "msg", waiting while it's
+///  empty.
+/// @param msg Where the message will be stored.
+/// @param mtype Must be "0": the queue is FIFO only.
+/// @param flags "IPC_NOWAIT" to behave as try_read() ("0" by default).
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int MpmcQueue<msg_t>::read_into(msg_t& msg, long mtype, int flags) {
+    if (mtype != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (this->try_read(msg) == 0) {
+        return 0;
+    }
+    if (flags & IPC_NOWAIT) {
+        return -1;
+    }
+    return this->park(this->control->items, this->control->consumers_waiting, false, NULL, &msg);
+}
+
+/// @brief Reads the first message of the queue without blocking.
+/// @param msg Where the message will be stored.
+/// @return "0" on success, "-1" with errno "ENOMSG" if the queue is empty, as
+///  in MsgQueue.
+template <class msg_t>
+int MpmcQueue<msg_t>::try_read(msg_t& msg) {
+    uint32_t pos = this->control->head.load(std::memory_order_relaxed), expected;
+    for (;;) {
+        Slot& slot = this->slots[pos & this->mask];
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+        int32_t diff = (int32_t) ((uint32_t) state - (pos + 1));
+        if (diff == 0 && (state >> 32) == 0) {
+            if (slot.state.compare_exchange_weak(state, pack(pos + 1, this->pid), std::memory_order_acquire)) {
+                expected = pos;
+                this->control->head.compare_exchange_strong(expected, pos + 1);
+                msg = slot.msg;
+                slot.state.store(pack(pos + this->mask + 1, 0), std::memory_order_seq_cst);
+                notify(this->control->spaces, this->control->producers_waiting);
+                return 0;
+            }
+            continue;
+        }
+        if (diff == 0 && (state >> 32) == DEAD_OWNER) {
+            // The writer died: free the slot and go on with the next one.
+            if (slot.state.compare_exchange_strong(state, pack(pos + this->mask + 1, 0), std::memory_order_seq_cst)) {
+                notify(this->control->spaces, this->control->producers_waiting);
+            }
+        } else if (diff < 0) {
+            errno = ENOMSG;
+            return -1;
+        }
+        expected = pos;
+        this->control->head.compare_exchange_strong(expected, pos + 1);
+        pos = this->control->head.load(std::memory_order_relaxed);
+    }
+}
+
+/// @brief Releases the slots a dead process was using, so the queue doesn't
+///  stay stuck behind them. Meant for the parent of a crashed worker, after
+///  waitpid(); blocking calls already do it when they get stuck.
+/// @param owner Pid of the dead process. It must not be running anymore.
+/// @return Amount of slots released, or "-1" if "owner" is not a valid pid.
+template <class msg_t>
+int MpmcQueue<msg_t>::recover(pid_t owner) {
+    int count = 0;
+    uint32_t i, seq;
+    uint64_t state;
+    if (owner <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i <= this->mask; i++) {
+        state = this->slots[i].state.load(std::memory_order_acquire);
+        if ((uint32_t) (state >> 32) != (uint32_t) owner) {
+            continue;
+        }
+        seq = (uint32_t) state;
+        if ((seq & this->mask) == i) {
+            // Died while writing: let the consumers skip it.
+            if (this->slots[i].state.compare_exchange_strong(state, pack(seq + 1, DEAD_OWNER))) {
+                notify(this->control->items, this->control->consumers_waiting);
+                count++;
+            }
+        } else {
+            // Died while reading: the slot is free again.
+            if (this->slots[i].state.compare_exchange_strong(state, pack(seq + this->mask, 0))) {
+                notify(this->control->spaces, this->control->producers_waiting);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/// @brief Returns the amount of messages in the queue, counting the ones being
+///  written or read right now.
+template <class msg_t>
+int MpmcQueue<msg_t>::get_msg_qtty(void) {
+    uint32_t head = this->control->head.load(std::memory_order_acquire);
+    int32_t qtty = (int32_t) (this->control->tail.load(std::memory_order_acquire) - head);
+    if (qtty < 0) {
+        return 0;
+    }
+    return (qtty > (int32_t) this->control->capacity) ? (int) this->control->capacity : (int) qtty;
+}
+
+/// @brief Returns the most messages the queue holds.
+template <class msg_t>
+int MpmcQueue<msg_t>::get_capacity(void) const {
+    return (int) this->control->capacity;
+}
+
+/// @brief Returns "true" if the queue is empty, "false" otherwise.
+template <class msg_t>
+bool MpmcQueue<msg_t>::is_empty(void) {
+    return (this->get_msg_qtty() == 0);
+}
+
+/// @brief Returns "true" if there is at least one message in the queue,
+///  "false" otherwise.
+template <class msg_t>
+bool MpmcQueue<msg_t>::has_msg(void) {
+    return (this->get_msg_qtty() > 0);
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Bytes of the segment: the control block and the slots. "0" to
+///  connect to an existing one.
+template <class msg_t>
+size_t MpmcQueue<msg_t>::segment_size(bool create, int capacity) {
+    size_t slots = 2;
+    if (!create) {
+        return 0;
+    }
+    if (capacity <= 0 || capacity > (1 << 30)) {
+        fprintf(stderr, ERROR("Capacity must be between 1 and 2^30 in MpmcQueue::MpmcQueue\n"));
+        throw(std::runtime_error("MpmcQueue"));
+    }
+    while (slots < (size_t) capacity) {
+        slots <<= 1;
+    }
+    return sizeof(Control) + slots * sizeof(Slot);
+}
+
+/// @brief Joins a sequence number and an owner in the state of a slot.
+template <class msg_t>
+uint64_t MpmcQueue<msg_t>::pack(uint32_t seq, uint32_t owner) {
+    return ((uint64_t) owner << 32) | seq;
+}
+
+/// @brief Sleeps while "*addr" is "value", shared between processes.
+/// @return "0" when woken up or if "*addr" changed, "1" if "timeout_ms"
+///  expired, "-1" on error.
+template <class msg_t>
+int MpmcQueue<msg_t>::futex_wait(std::atomic<uint32_t>* addr, uint32_t value, int timeout_ms) {
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    if (syscall(SYS_futex, (uint32_t*) addr, FUTEX_WAIT, value, &timeout, NULL, 0) == -1) {
+        if (errno == ETIMEDOUT) {
+            return 1;
+        }
+        if (errno != EAGAIN && errno != EINTR) {
+            perror(ERROR("futex in MpmcQueue::futex_wait"));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Wakes up one of the processes sleeping on "event", if any. Only the
+///  counter of sleepers is read when there are none.
+template <class msg_t>
+void MpmcQueue<msg_t>::notify(std::atomic<uint32_t>& event, std::atomic<uint32_t>& waiting) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+    event.fetch_add(1, std::memory_order_seq_cst);
+    if (syscall(SYS_futex, (uint32_t*) &event, FUTEX_WAKE, 1, NULL, NULL, 0) == -1) {
+        perror(ERROR("futex in MpmcQueue::notify"));
+    }
+}
+
+/// @brief Blocking part of write() and read_into(): registers as a sleeper,
+///  tries again, and sleeps on "event" until the other side bumps it. Every
+///  "RECOVERY_MS" milliseconds without progress, it checks if the slot it's
+///  waiting for belongs to a dead process.
+/// @param producer "true" to write "in", "false" to read into "out".
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int MpmcQueue<msg_t>::park(std::atomic<uint32_t>& event, std::atomic<uint32_t>& waiting, bool producer, const msg_t* in, msg_t* out) {
+    int status;
+    uint32_t value;
+    for (;;) {
+        value = event.load(std::memory_order_seq_cst);
+        waiting.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ( (status = (producer) ? this->try_write(*in) : this->try_read(*out) ) == 0) {
+            waiting.fetch_sub(1, std::memory_order_relaxed);
+            return 0;
+        }
+        status = futex_wait(&event, value, RECOVERY_MS);
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        if (status == -1) {
+            return -1;
+        }
+        if (status == 1) {
+            this->recover_blocker((producer) ? this->control->tail : this->control->head);
+        }
+        if ( (status = (producer) ? this->try_write(*in) : this->try_read(*out) ) == 0) {
+            return 0;
+        }
+    }
+}
+
+/// @brief Recovers the slot at "position" if its owner is dead.
+template <class msg_t>
+void MpmcQueue<msg_t>::recover_blocker(std::atomic<uint32_t>& position) {
+    uint32_t pos = position.load(std::memory_order_acquire);
+    uint32_t owner = (uint32_t) (this->slots[pos & this->mask].state.load(std::memory_order_acquire) >> 32);
+    if (owner == 0 || owner == DEAD_OWNER || owner == this->pid) {
+        return;
+    }
+    if (kill((pid_t) owner, 0) == -1 && errno == ESRCH) {
+        this->recover((pid_t) owner);
+    }
+}
+
+/******************************************************************************
+ * Overloaded operators
+******************************************************************************/
+
+/// @brief Writes a message. Might throw "std::runtime_error".
+template <class msg_t>
+MpmcQueue<msg_t>& MpmcQueue<msg_t>::operator<<(msg_t msg) {
+    if (this->write(msg) == -1) {
+        throw(std::runtime_error("MpmcQueue::operator<<"));
+    }
+    return *this;
+}
+
+/// @brief Reads the first message of the queue. Might throw "std::runtime_error".
+template <class msg_t>
+MpmcQueue<msg_t>& MpmcQueue<msg_t>::operator>>(msg_t& msg) {
+    if (this->read_into(msg) == -1) {
+        throw(std::runtime_error("MpmcQueue::operator>>"));
+    }
+    return *this;
+}
+
+#endif // MPMC_QUEUE_H
@@ -5,32 +5,84 @@
 #include <sys/ipc.h>
 #include <stdio.h>
 #include <sys/msg.h>
+#include <string.h>
 #include "tools.h"
 #include <stdexcept>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+
+/// @brief What a write does when the queue is full, see
+///  MsgQueue::set_overflow_policy():
+///  * MSG_QUEUE_BLOCK; Waits until there is room, as msgsnd() does.
+///  * MSG_QUEUE_DROP_NEWEST; Discards the message being written.
+///  * MSG_QUEUE_DROP_OLDEST; Discards the oldest message of the queue, of any
+///  type, to make room for the new one. Fails with errno "EMSGSIZE" if the
+///  message doesn't fit even in the empty queue.
+///  * MSG_QUEUE_FAIL; Fails with errno "EAGAIN".
+enum MsgQueueOverflow {
+    MSG_QUEUE_BLOCK,
+    MSG_QUEUE_DROP_NEWEST,
+    MSG_QUEUE_DROP_OLDEST,
+    MSG_QUEUE_FAIL
+};
+
+/// @brief Counters of one MsgQueue object, about the messages it wrote and read
+///  itself, to size the queue from data.
+struct MsgQueueStats {
+    unsigned long enqueued;     // Messages written.
+    unsigned long dequeued;     // Messages read, without peek().
+    unsigned long dropped;      // Messages discarded by the overflow policy.
+    int depth;                  // Messages in the queue, when read.
+    int high_water;             // Most messages seen after a write. Only with
+                                //  track_depth().
+    long long blocked_ns;       // Time writes waited on a full queue.
+};
 
 template <class msg_t>
 class MsgQueue {
-private:
-    struct msgbuf {
+public:
+    /// @brief Message as stored in the queue. Filled in place and sent with
+    ///  write_msg(), or received with read_msg(), without copying "msg".
+    struct Message {
         long mtype;
         msg_t msg;
     };
+
+private:
     int msg_id;
     bool creator;
     pid_t pid;
+    MsgQueueOverflow overflow_policy;
+    MsgQueueStats stats;
+    bool tracking_depth;
+    int send(const Message& message, size_t len, int timeout_ms);
+    static long long elapsed_ns(const struct timespec& start);
 
 public:
     MsgQueue(const char* path, int id, bool create=false);
     ~MsgQueue();
     bool static exists(const char* path, int id);
-    int write(msg_t msg, long mtype=1);
+    int write(const msg_t& msg, long mtype=1);
+    int write_msg(const Message& message, size_t len=sizeof(msg_t), int flags=0);
+    int write_many(const msg_t* msgs, int count, long mtype=1, int flags=0);
+    int try_write(const msg_t& msg, long mtype=1);
+    int write_timed(const msg_t& msg, int timeout_ms, long mtype=1);
     msg_t read(int mtype=0, int* status=NULL, int flags=0);
+    int read_into(msg_t& msg, long mtype=0, int flags=0);
+    ssize_t read_msg(Message& message, long mtype=0, int flags=0);
+    int read_many(msg_t* msgs, int count, long mtype=0, int flags=0);
     msg_t peek(int index, int* status=NULL);
     int get_msg_qtty(void);
     bool is_empty(void);
     bool has_msg(void);
+    int set_capacity(size_t bytes);
+    long get_capacity(void);
+    void set_overflow_policy(MsgQueueOverflow policy);
+    MsgQueueOverflow get_overflow_policy(void) const;
+    void track_depth(bool enable);
+    MsgQueueStats get_stats(void);
+    void reset_stats(void);
     MsgQueue& operator<<(msg_t msg);
     MsgQueue& operator>>(msg_t& msg);
 };
@@ -49,10 +101,11 @@ public:
 ///  already existing one.
 /// @return If error, throws an exception with std::runtime_error
 template <class msg_t>
-MsgQueue<msg_t>::MsgQueue(const char* path, int id, bool create): creator(create) {
+MsgQueue<msg_t>::MsgQueue(const char* path, int id, bool create):
+    creator(create), overflow_policy(MSG_QUEUE_BLOCK), tracking_depth(false) {
     key_t key;
-    int flags = (create) ? (IPC_CREAT | 0666) : 0;
     this->pid = gettid();
+    this->reset_stats();
     if ( (key = ftok(path, id) ) == -1) {
         perror(ERROR("ftok in MsgQueue::MsgQueue"));
         throw(std::runtime_error("ftok"));
@@ -95,23 +148,92 @@ bool MsgQueue<msg_t>::exists(const char* path, int id) {
     return true;
 }
 
-/// @brief Writes a message in the queue.
+/// @brief Writes a message in the queue. If it's full, it follows the
+///  overflow policy, which blocks by default.
 /// @param msg Message to be written.
 /// @param mtype Message identifier (default "1").
-/// @return "0" on success, "-1" on error.
+/// @return "0" on success, also if the policy dropped a message, "-1" on
+///  error.
 template <class msg_t>
-int MsgQueue<msg_t>::write(msg_t msg, long mtype) {
-    struct msgbuf sending_msg;
+int MsgQueue<msg_t>::write(const msg_t& msg, long mtype) {
+    Message sending_msg;
     if (mtype <= 0) {
         mtype = 1;
     }
     sending_msg.mtype = mtype;
     sending_msg.msg = msg;
-    if (msgsnd(this->msg_id, &sending_msg, (size_t) sizeof(msg_t), 0) == -1) {
-        perror(ERROR("msgsnd in MsgQueue::write"));
+    return this->send(sending_msg, sizeof(msg_t), -1);
+}
+
+/// @brief Writes a message built in place, without copying it. With "len", only
+///  the bytes used are sent, so short messages of a type with a variable
+///  length part, as a trailing array, don't pay for the largest size.
+/// @param message Message to be written. "mtype" must be positive.
+/// @param len Bytes of "message.msg" to send, up to "sizeof(msg_t)" (default).
+/// @param flags "IPC_NOWAIT" to never block, as try_write() ("0" by default).
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int MsgQueue<msg_t>::write_msg(const Message& message, size_t len, int flags) {
+    if (len > sizeof(msg_t) || message.mtype <= 0) {
+        errno = EINVAL;
         return -1;
     }
-    return 0;
+    return this->send(message, len, (flags & IPC_NOWAIT) ? 0 : -1);
+}
+
+/// @brief Writes several messages with the same "mtype", in order. System V
+///  queues have no batched call, so it's one "msgsnd()" per message, through a
+///  single buffer.
+/// @param msgs Messages to be written.
+/// @param count Amount of messages in "msgs".
+/// @param mtype Message identifier (default "1").
+/// @param flags "IPC_NOWAIT" to never block, as try_write() ("0" by default).
+/// @return Amount of messages written or dropped by the overflow policy, which
+///  is less than "count" if a write failed, or "-1" if none could be written.
+template <class msg_t>
+int MsgQueue<msg_t>::write_many(const msg_t* msgs, int count, long mtype, int flags) {
+    Message sending_msg;
+    int i;
+    sending_msg.mtype = (mtype <= 0) ? 1 : mtype;
+    for (i = 0; i < count; i++) {
+        sending_msg.msg = msgs[i];
+        if (this->send(sending_msg, sizeof(msg_t), (flags & IPC_NOWAIT) ? 0 : -1) == -1) {
+            break;
+        }
+    }
+    return (i == 0 && count > 0) ? -1 : i;
+}
+
+/// @brief Writes a message without blocking. If the queue is full, it follows
+///  the overflow policy, and fails as "MSG_QUEUE_FAIL" does with
+///  "MSG_QUEUE_BLOCK".
+/// @param msg Message to be written.
+/// @param mtype Message identifier (default "1").
+/// @return "0" on success, also if the policy dropped a message, "-1" on
+///  error. "-1" with errno "EAGAIN" if the queue is full.
+template <class msg_t>
+int MsgQueue<msg_t>::try_write(const msg_t& msg, long mtype) {
+    Message sending_msg;
+    sending_msg.mtype = (mtype <= 0) ? 1 : mtype;
+    sending_msg.msg = msg;
+    return this->send(sending_msg, sizeof(msg_t), 0);
+}
+
+/// @brief Writes a message, waiting at most "timeout_ms" milliseconds for room
+///  with "MSG_QUEUE_BLOCK". Other policies behave as in write().
+///  System V queues have no timed send, so it retries without blocking, with
+///  sleeps that grow up to 5 ms.
+/// @param msg Message to be written.
+/// @param timeout_ms Maximum milliseconds to wait.
+/// @param mtype Message identifier (default "1").
+/// @return "0" on success, "-1" on error. "-1" with errno "ETIMEDOUT" if the
+///  queue was still full after "timeout_ms".
+template <class msg_t>
+int MsgQueue<msg_t>::write_timed(const msg_t& msg, int timeout_ms, long mtype) {
+    Message sending_msg;
+    sending_msg.mtype = (mtype <= 0) ? 1 : mtype;
+    sending_msg.msg = msg;
+    return this->send(sending_msg, sizeof(msg_t), (timeout_ms < 0) ? 0 : timeout_ms);
 }
 
 /// @brief Reads the queue. By default, in a blocking manner.
@@ -131,11 +253,13 @@ int MsgQueue<msg_t>::write(msg_t msg, long mtype) {
 /// @return The value returned from the message queue.
 template <class msg_t>
 msg_t MsgQueue<msg_t>::read(int mtype, int* status, int flags) {
-    struct msgbuf output;
+    Message output;
     int error_state = 0;
     if( msgrcv(this->msg_id, &output, (size_t) sizeof(msg_t), (long) mtype, flags) == -1) {
         error_state = errno;
         perror(ERROR("msgrcv in MsgQueue::read"));
+    } else if (!(flags & MSG_COPY)) {
+        this->stats.dequeued++;
     }
     if (status != NULL) {
         *status = error_state;
@@ -143,13 +267,73 @@ msg_t MsgQueue<msg_t>::read(int mtype, int* status, int flags) {
     return output.msg;
 }
 
+/// @brief Reads the queue into "msg", like read(), but reporting errors
+///  through the return value. The message is still received in a Message and
+///  copied once into "msg"; read_msg() is the one that avoids that copy.
+/// @param msg Where the message will be stored.
+/// @param mtype Which message to get, as in read() ("0" by default).
+/// @param flags As in read() ("0" by default).
+/// @return "0" on success, "-1" on error. "-1" with errno "ENOMSG" if there
+///  was no message with "IPC_NOWAIT".
+template <class msg_t>
+int MsgQueue<msg_t>::read_into(msg_t& msg, long mtype, int flags) {
+    Message output;
+    if (this->read_msg(output, mtype, flags) == -1) {
+        return -1;
+    }
+    msg = output.msg;
+    return 0;
+}
+
+/// @brief Reads a message in place, with its "mtype" and its length, which is
+///  shorter than "sizeof(msg_t)" if it was written with write_msg() and a
+///  length. The bytes not received are left untouched.
+/// @param message Where the message will be stored.
+/// @param mtype Which message to get, as in read() ("0" by default).
+/// @param flags As in read() ("0" by default).
+/// @return Bytes of "message.msg" received, or "-1" on error. "-1" with errno
+///  "ENOMSG" if there was no message with "IPC_NOWAIT".
+template <class msg_t>
+ssize_t MsgQueue<msg_t>::read_msg(Message& message, long mtype, int flags) {
+    ssize_t len;
+    if ( (len = msgrcv(this->msg_id, &message, (size_t) sizeof(msg_t), mtype, flags) ) == -1) {
+        if (errno != ENOMSG) {
+            perror(ERROR("msgrcv in MsgQueue::read_msg"));
+        }
+        return -1;
+    }
+    this->stats.dequeued++;
+    return len;
+}
+
+/// @brief Reads up to "count" messages: waits for the first one, as read()
+///  does, and takes the rest only if they are already there, so a reader can
+///  drain a burst of small messages in a single call.
+/// @param msgs Where the messages will be stored.
+/// @param count Size of "msgs".
+/// @param mtype Which messages to get, as in read() ("0" by default).
+/// @param flags As in read(). With "IPC_NOWAIT", it doesn't wait for the first
+///  one either ("0" by default).
+/// @return Amount of messages read, or "-1" on error. "-1" with errno "ENOMSG"
+///  if there was no message with "IPC_NOWAIT".
+template <class msg_t>
+int MsgQueue<msg_t>::read_many(msg_t* msgs, int count, long mtype, int flags) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (this->read_into(msgs[i], mtype, (i == 0) ? flags : flags | IPC_NOWAIT) == -1) {
+            break;
+        }
+    }
+    return (i == 0 && count > 0) ? -1 : i;
+}
+
 /// @brief Returns a copy of a message in the queue, without popping it.
 /// @param index Position in the queue, starting with "0".
 /// @param status If "0", the value was retrieved successfully. If != 0, then
 ///  no message was found, and the value returned is junk.
 template <class msg_t>
 msg_t MsgQueue<msg_t>::peek(int index, int* status) {
-    struct msgbuf output;
+    Message output;
     output.msg = this->read(index, status, IPC_NOWAIT | MSG_COPY);
     return output.msg;
 }
@@ -158,7 +342,7 @@ msg_t MsgQueue<msg_t>::peek(int index, int* status) {
 template <class msg_t>
 int MsgQueue<msg_t>::get_msg_qtty(void) {
     struct msqid_ds info;
-    if (msgctl(this->msg_id, MSG_STAT, &info) == -1) {
+    if (msgctl(this->msg_id, IPC_STAT, &info) == -1) {
         perror(ERROR("msgctl in MsgQueue::get_msg_qtty"));
         return -1;
     }
@@ -178,6 +362,169 @@ bool MsgQueue<msg_t>::has_msg(void) {
     return (this->get_msg_qtty() > 0);
 }
 
+/// @brief Sets the most bytes of messages the queue holds, "msg_qbytes", so it
+///  fills up, and writes block or overflow, at that point. Only the "msg_t"
+///  part of each message counts.
+/// @param bytes New capacity. Going over "/proc/sys/kernel/msgmnb" needs
+///  "CAP_SYS_RESOURCE".
+/// @return "0" on success, "-1" on error. "-1" with errno "EINVAL" if
+///  "bytes" can't hold a single message, "EPERM" if not the owner of the
+///  queue, or over the limit without the capability.
+template <class msg_t>
+int MsgQueue<msg_t>::set_capacity(size_t bytes) {
+    struct msqid_ds info;
+    if (bytes < sizeof(msg_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (msgctl(this->msg_id, IPC_STAT, &info) == -1) {
+        perror(ERROR("msgctl in MsgQueue::set_capacity"));
+        return -1;
+    }
+    info.msg_qbytes = (msglen_t) bytes;
+    if (msgctl(this->msg_id, IPC_SET, &info) == -1) {
+        perror(ERROR("msgctl in MsgQueue::set_capacity"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Returns the most bytes of messages the queue holds, or "-1" on
+///  error.
+template <class msg_t>
+long MsgQueue<msg_t>::get_capacity(void) {
+    struct msqid_ds info;
+    if (msgctl(this->msg_id, IPC_STAT, &info) == -1) {
+        perror(ERROR("msgctl in MsgQueue::get_capacity"));
+        return -1;
+    }
+    return (long) info.msg_qbytes;
+}
+
+/// @brief Sets what writes do when the queue is full, see MsgQueueOverflow.
+///  It only affects this object ("MSG_QUEUE_BLOCK" by default).
+template <class msg_t>
+void MsgQueue<msg_t>::set_overflow_policy(MsgQueueOverflow policy) {
+    this->overflow_policy = policy;
+}
+
+/// @brief Returns what writes do when the queue is full.
+template <class msg_t>
+MsgQueueOverflow MsgQueue<msg_t>::get_overflow_policy(void) const {
+    return this->overflow_policy;
+}
+
+/// @brief Enables the "high_water" statistic. It costs a "msgctl()" after each
+///  write, so it's disabled by default.
+template <class msg_t>
+void MsgQueue<msg_t>::track_depth(bool enable) {
+    this->tracking_depth = enable;
+}
+
+/// @brief Returns the counters of this object, with the current depth of the
+///  queue ("-1" if it can't be read).
+template <class msg_t>
+MsgQueueStats MsgQueue<msg_t>::get_stats(void) {
+    this->stats.depth = this->get_msg_qtty();
+    return this->stats;
+}
+
+/// @brief Sets the counters to zero.
+template <class msg_t>
+void MsgQueue<msg_t>::reset_stats(void) {
+    memset(&this->stats, 0, sizeof(this->stats));
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Body of every write: sends without blocking, and if the queue is
+///  full, follows the overflow policy. The time spent waiting is counted in
+///  the statistics.
+/// @param timeout_ms With "MSG_QUEUE_BLOCK", "-1" blocks in msgsnd(), "0"
+///  fails with errno "EAGAIN", and more retries up to that many milliseconds
+///  before failing with "ETIMEDOUT".
+/// @return "0" on success or if the message was dropped, "-1" on error.
+///  "-1" with errno "EMSGSIZE" if "MSG_QUEUE_DROP_OLDEST" emptied the queue
+///  and the message still doesn't fit.
+template <class msg_t>
+int MsgQueue<msg_t>::send(const Message& message, size_t len, int timeout_ms) {
+    Message discarded;
+    struct msqid_ds info;
+    struct timespec start;
+    bool waited = false, emptied = false;
+    int delay_us = 50;
+    while (msgsnd(this->msg_id, &message, len, IPC_NOWAIT) == -1) {
+        if (errno != EAGAIN) {
+            perror(ERROR("msgsnd in MsgQueue::send"));
+            return -1;
+        }
+        if (this->overflow_policy == MSG_QUEUE_DROP_NEWEST) {
+            this->stats.dropped++;
+            return 0;
+        }
+        if (this->overflow_policy == MSG_QUEUE_DROP_OLDEST) {
+            if (msgrcv(this->msg_id, &discarded, sizeof(msg_t), 0, IPC_NOWAIT | MSG_NOERROR) != -1) {
+                this->stats.dropped++;
+                emptied = false;
+                continue;
+            }
+            if (errno != ENOMSG) {
+                perror(ERROR("msgrcv in MsgQueue::send"));
+                return -1;
+            }
+            // Retried once, in case another reader emptied the queue.
+            if (emptied) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            emptied = true;
+            continue;
+        }
+        if (this->overflow_policy == MSG_QUEUE_FAIL || timeout_ms == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (!waited) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            waited = true;
+        }
+        if (timeout_ms < 0) {
+            if (msgsnd(this->msg_id, &message, len, 0) == -1) {
+                perror(ERROR("msgsnd in MsgQueue::send"));
+                this->stats.blocked_ns += elapsed_ns(start);
+                return -1;
+            }
+            break;
+        }
+        if (elapsed_ns(start) >= timeout_ms * 1000000LL) {
+            this->stats.blocked_ns += elapsed_ns(start);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        usleep(delay_us);
+        delay_us = (delay_us < 2500) ? delay_us * 2 : 5000;
+    }
+    if (waited) {
+        this->stats.blocked_ns += elapsed_ns(start);
+    }
+    this->stats.enqueued++;
+    if (this->tracking_depth && msgctl(this->msg_id, IPC_STAT, &info) != -1
+        && (int) info.msg_qnum > this->stats.high_water) {
+        this->stats.high_water = (int) info.msg_qnum;
+    }
+    return 0;
+}
+
+/// @brief Nanoseconds since "start", in "CLOCK_MONOTONIC".
+template <class msg_t>
+long long MsgQueue<msg_t>::elapsed_ns(const struct timespec& start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec);
+}
+
 /******************************************************************************
  * Overloaded operators
 ******************************************************************************/
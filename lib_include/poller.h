@@ -0,0 +1,76 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "socket.h"
+#include "sig.h"
+#include "tools.h"
+#include <stdexcept>
+#include <errno.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+
+/// @brief Waits on many Sockets and file descriptors at once with epoll, so a
+///  single thread can attend hundreds of connections. Every descriptor is
+///  registered with its interest ("EPOLLIN", "EPOLLOUT"...), level or edge
+///  triggered, and a pointer of user data that is given back with its events.
+///  Eventfds, timerfds and signalfds can be created and registered in one
+///  call. Only notify() can be called from other threads.
+class Poller {
+public:
+    /// @brief What a registered descriptor is.
+    enum Type {
+        FD,         // Added with add(int fd, ...).
+        SOCKET,     // Added with add(Socket& socket, ...).
+        EVENT,      // Eventfd created by add_event().
+        TIMER,      // Timerfd created by add_timer().
+        SIGNAL      // Signalfd created by add_signal().
+    };
+    /// @brief Ready descriptor, as returned by wait().
+    struct Event {
+        int fd;
+        uint32_t events;    // "EPOLLIN", "EPOLLOUT", "EPOLLERR", "EPOLLHUP"...
+        Type type;
+        void* data;         // User data given when it was added.
+    };
+
+private:
+    struct Entry {
+        int fd;
+        Type type;
+        void* data;
+    };
+    int epfd;
+    std::map<int, Entry*> entries;
+    std::vector<struct epoll_event> ready;     // Reused by every wait().
+    int add_entry(int fd, Type type, uint32_t events, bool edge, void* data);
+
+public:
+    Poller();
+    ~Poller();
+
+    int add(Socket& socket, uint32_t events=EPOLLIN, bool edge=false, void* data=NULL);
+    int add(int fd, uint32_t events=EPOLLIN, bool edge=false, void* data=NULL);
+    int modify(int fd, uint32_t events, bool edge=false);
+    int remove(int fd);
+    int add_event(void* data=NULL);
+    int add_timer(int interval_ms, bool periodic=true, void* data=NULL);
+    int add_signal(int signal, void* data=NULL);
+
+    int wait(Event* events, int max_events, int timeout=-1);
+    static int notify(int fd, uint64_t value=1);
+    static int consume(int fd, uint64_t* value=NULL);
+    static int read_signal(int fd);
+    int get_size(void) const;
+};
+
+#endif // POLLER_H
@@ -0,0 +1,440 @@
+#ifndef POSIX_MSG_QUEUE_H
+#define POSIX_MSG_QUEUE_H
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mqueue.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "tools.h"
+#include <stdexcept>
+#include <errno.h>
+#include <unistd.h>
+
+/// @brief Message queue of POSIX, with the interface of MsgQueue, so code can
+///  switch between both with a type alias. Unlike MsgQueue, its descriptor,
+///  from get_fd(), can be waited on with epoll or a Poller, together with
+///  sockets, timers and signals, instead of blocking a thread per queue.
+///
+///  POSIX queues have priorities instead of types: the "mtype" of the writing
+///  functions is the priority of the message, and the highest one is read
+///  first. Reading functions only take "mtype=0", and give back the priority in
+///  "Message::mtype". peek() isn't supported.
+/// @tparam msg_t Type of the message, with the same restrictions of MsgQueue.
+///  Its size must be within "/proc/sys/fs/mqueue/msgsize_max".
+template <class msg_t>
+class PosixMsgQueue {
+public:
+    /// @brief Message as stored in the queue, with its priority in "mtype".
+    struct Message {
+        long mtype;
+        msg_t msg;
+    };
+
+private:
+    mqd_t mqd;
+    char name[32];
+    bool creator;
+    pid_t pid;
+    static void make_name(const char* path, int id, char* name);
+    static unsigned int get_priority(long mtype);
+    static void get_deadline(int timeout_ms, struct timespec* deadline);
+
+public:
+    PosixMsgQueue(const char* path, int id, bool create=false, long max_msgs=0);
+    ~PosixMsgQueue();
+    bool static exists(const char* path, int id);
+    int write(const msg_t& msg, long mtype=1);
+    int write_msg(const Message& message, size_t len=sizeof(msg_t), int flags=0);
+    int write_many(const msg_t* msgs, int count, long mtype=1, int flags=0);
+    msg_t read(int mtype=0, int* status=NULL, int flags=0);
+    int read_into(msg_t& msg, long mtype=0, int flags=0);
+    ssize_t read_msg(Message& message, long mtype=0, int flags=0);
+    int read_many(msg_t* msgs, int count, long mtype=0, int flags=0);
+    int read_timed(msg_t& msg, int timeout_ms, long* priority=NULL);
+    msg_t peek(int index, int* status=NULL);
+    int get_msg_qtty(void);
+    int get_fd(void) const;
+    bool is_empty(void);
+    bool has_msg(void);
+    PosixMsgQueue& operator<<(msg_t msg);
+    PosixMsgQueue& operator>>(msg_t& msg);
+};
+
+/******************************************************************************
+ * Template functions
+******************************************************************************/
+
+/// @brief Creates a message queue, or connects to an existing one. Its name in
+///  "/dev/mqueue" comes from "path" and "id", as the key of MsgQueue.
+/// @param path Can be any path. Identifier for the message queue.
+/// @param id Can be any number. Identifier for the message queue.
+/// @param create If "true", create the queue. If "false", connect to an
+///  already existing one.
+/// @param max_msgs Most messages the queue holds, up to
+///  "/proc/sys/fs/mqueue/msg_max" for unprivileged processes. "0" takes that
+///  limit. Only used with "create" ("0" by default).
+/// @return If error, throws an exception with std::runtime_error
+template <class msg_t>
+PosixMsgQueue<msg_t>::PosixMsgQueue(const char* path, int id, bool create, long max_msgs): creator(create) {
+    struct mq_attr attr;
+    FILE* limit;
+    this->pid = gettid();
+    make_name(path, id, this->name);
+    if (this->name[0] == '\0') {
+        perror(ERROR("ftok in PosixMsgQueue::PosixMsgQueue"));
+        throw(std::runtime_error("ftok"));
+    }
+    if (create) {
+        if (max_msgs <= 0) {
+            max_msgs = 10;
+            if ( (limit = fopen("/proc/sys/fs/mqueue/msg_max", "r") ) != NULL) {
+                if (fscanf(limit, "%ld", &max_msgs) != 1) {
+                    max_msgs = 10;
+                }
+                fclose(limit);
+            }
+        }
+        memset(&attr, 0, sizeof(attr));
+        attr.mq_maxmsg = max_msgs;
+        attr.mq_msgsize = sizeof(msg_t);
+        if ( (this->mqd = mq_open(this->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666, &attr) ) == (mqd_t) -1) {
+            perror(ERROR("mq_open in PosixMsgQueue::PosixMsgQueue"));
+            throw(std::runtime_error("mq_open"));
+        }
+    } else {
+        if ( (this->mqd = mq_open(this->name, O_RDWR | O_CLOEXEC) ) == (mqd_t) -1) {
+            perror(ERROR("mq_open in PosixMsgQueue::PosixMsgQueue"));
+            throw(std::runtime_error("mq_open"));
+        }
+        if (mq_getattr(this->mqd, &attr) == -1 || attr.mq_msgsize != (long) sizeof(msg_t)) {
+            fprintf(stderr, ERROR("Message size doesn't match the queue in PosixMsgQueue::PosixMsgQueue\n"));
+            mq_close(this->mqd);
+            throw(std::runtime_error("PosixMsgQueue"));
+        }
+    }
+}
+
+/// @brief Closes the queue. Destroys it only if you are the creator, and are
+///  in the same thread or proccess.
+template <class msg_t>
+PosixMsgQueue<msg_t>::~PosixMsgQueue(void) {
+    if (mq_close(this->mqd) == -1) {
+        perror(ERROR("mq_close in PosixMsgQueue::~PosixMsgQueue"));
+    }
+    if (this->creator && this->pid == gettid()) {
+        if (mq_unlink(this->name) == -1) {
+            perror(ERROR("mq_unlink in PosixMsgQueue::~PosixMsgQueue"));
+        }
+    }
+}
+
+/// @brief Checks if the message queue already exists.
+/// @return "true" if it exists, "false" otherwise.
+template <class msg_t>
+bool PosixMsgQueue<msg_t>::exists(const char* path, int id) {
+    char name[32];
+    mqd_t mqd;
+    make_name(path, id, name);
+    if (name[0] == '\0') {
+        return false;
+    }
+    if ( (mqd = mq_open(name, O_RDONLY | O_CLOEXEC) ) == (mqd_t) -1) {
+        return false;
+    }
+    mq_close(mqd);
+    return true;
+}
+
+/// @brief Writes a message in the queue.
+/// @param msg Message to be written.
+/// @param mtype Priority of the message, from "0" to "MQ_PRIO_MAX - 1"
+///  (default "1").
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int PosixMsgQueue<msg_t>::write(const msg_t& msg, long mtype) {
+    if (mq_send(this->mqd, (const char*) &msg, sizeof(msg_t), get_priority(mtype)) == -1) {
+        perror(ERROR("mq_send in PosixMsgQueue::write"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Writes a message built in place, with only "len" bytes of it.
+/// @param message Message to be written, with its priority in "mtype".
+/// @param len Bytes of "message.msg" to send, up to "sizeof(msg_t)" (default).
+/// @param flags "IPC_NOWAIT" to fail with errno "EAGAIN" instead of blocking
+///  when the queue is full ("0" by default).
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int PosixMsgQueue<msg_t>::write_msg(const Message& message, size_t len, int flags) {
+    struct timespec now = {0, 0};
+    int status;
+    if (len > sizeof(msg_t) || message.mtype < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (flags & IPC_NOWAIT) {
+        // A deadline in the past: it fails right away if the queue is full.
+        if ( (status = mq_timedsend(this->mqd, (const char*) &message.msg, len, get_priority(message.mtype), &now) ) == -1
+            && errno == ETIMEDOUT) {
+            errno = EAGAIN;
+            return -1;
+        }
+    } else {
+        status = mq_send(this->mqd, (const char*) &message.msg, len, get_priority(message.mtype));
+    }
+    if (status == -1) {
+        perror(ERROR("mq_send in PosixMsgQueue::write_msg"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Writes several messages with the same priority, in order, one
+///  "mq_send()" each.
+/// @param msgs Messages to be written.
+/// @param count Amount of messages in "msgs".
+/// @param mtype Priority of the messages (default "1").
+/// @param flags "IPC_NOWAIT" to stop instead of blocking when the queue is
+///  full ("0" by default).
+/// @return Amount of messages written, which is less than "count" if the queue
+///  filled up with "IPC_NOWAIT", or "-1" if none could be written.
+template <class msg_t>
+int PosixMsgQueue<msg_t>::write_many(const msg_t* msgs, int count, long mtype, int flags) {
+    Message sending_msg;
+    int i;
+    sending_msg.mtype = (mtype < 0) ? 0 : mtype;
+    for (i = 0; i < count; i++) {
+        sending_msg.msg = msgs[i];
+        if (this->write_msg(sending_msg, sizeof(msg_t), flags) == -1) {
+            break;
+        }
+    }
+    return (i == 0 && count > 0) ? -1 : i;
+}
+
+/// @brief Reads the message with the highest priority, the oldest one among
+///  equals. By default, in a blocking manner.
+/// @param mtype Must be "0".
+/// @param status If not NULL, it will be loaded with a "0" on success, or with
+///  the "errno" value in case of error.
+/// @param flags "IPC_NOWAIT" for a non-blocking read ("0" by default).
+/// @return The value returned from the message queue.
+template <class msg_t>
+msg_t PosixMsgQueue<msg_t>::read(int mtype, int* status, int flags) {
+    Message output;
+    int error_state = 0;
+    memset(&output, 0, sizeof(output));
+    if (this->read_msg(output, mtype, flags) == -1) {
+        error_state = errno;
+    }
+    if (status != NULL) {
+        *status = error_state;
+    }
+    return output.msg;
+}
+
+/// @brief Reads the queue into "msg", like read(), without returning the
+///  message by value.
+/// @param msg Where the message will be stored.
+/// @param mtype Must be "0".
+/// @param flags As in read() ("0" by default).
+/// @return "0" on success, "-1" on error. "-1" with errno "ENOMSG" if there
+///  was no message with "IPC_NOWAIT".
+template <class msg_t>
+int PosixMsgQueue<msg_t>::read_into(msg_t& msg, long mtype, int flags) {
+    Message output;
+    if (this->read_msg(output, mtype, flags) == -1) {
+        return -1;
+    }
+    msg = output.msg;
+    return 0;
+}
+
+/// @brief Reads a message in place, with its priority in "mtype" and its
+///  length, shorter than "sizeof(msg_t)" if it was written with write_msg()
+///  and a length. The bytes not received are left untouched.
+/// @param message Where the message will be stored.
+/// @param mtype Must be "0".
+/// @param flags As in read() ("0" by default).
+/// @return Bytes of "message.msg" received, or "-1" on error. "-1" with errno
+///  "ENOMSG" if there was no message with "IPC_NOWAIT".
+template <class msg_t>
+ssize_t PosixMsgQueue<msg_t>::read_msg(Message& message, long mtype, int flags) {
+    struct timespec now = {0, 0};
+    unsigned int priority;
+    ssize_t len;
+    if (mtype != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (flags & IPC_NOWAIT) {
+        if ( (len = mq_timedreceive(this->mqd, (char*) &message.msg, sizeof(msg_t), &priority, &now) ) == -1
+            && errno == ETIMEDOUT) {
+            errno = ENOMSG;
+            return -1;
+        }
+    } else {
+        len = mq_receive(this->mqd, (char*) &message.msg, sizeof(msg_t), &priority);
+    }
+    if (len == -1) {
+        perror(ERROR("mq_receive in PosixMsgQueue::read_msg"));
+        return -1;
+    }
+    message.mtype = (long) priority;
+    return len;
+}
+
+/// @brief Reads up to "count" messages: waits for the first one, as read()
+///  does, and takes the rest only if they are already there.
+/// @param msgs Where the messages will be stored.
+/// @param count Size of "msgs".
+/// @param mtype Must be "0".
+/// @param flags As in read(). With "IPC_NOWAIT", it doesn't wait for the first
+///  one either ("0" by default).
+/// @return Amount of messages read, or "-1" on error. "-1" with errno "ENOMSG"
+///  if there was no message with "IPC_NOWAIT".
+template <class msg_t>
+int PosixMsgQueue<msg_t>::read_many(msg_t* msgs, int count, long mtype, int flags) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (this->read_into(msgs[i], mtype, (i == 0) ? flags : flags | IPC_NOWAIT) == -1) {
+            break;
+        }
+    }
+    return (i == 0 && count > 0) ? -1 : i;
+}
+
+/// @brief Reads the message with the highest priority, waiting at most
+///  "timeout_ms" milliseconds for one.
+/// @param msg Where the message will be stored.
+/// @param timeout_ms Maximum milliseconds to wait.
+/// @param priority If not NULL, where the priority of the message is stored.
+/// @return "0" on success, "-1" on error. "-1" with errno "ETIMEDOUT" if no
+///  message came in time.
+template <class msg_t>
+int PosixMsgQueue<msg_t>::read_timed(msg_t& msg, int timeout_ms, long* priority) {
+    struct timespec deadline;
+    unsigned int aux;
+    get_deadline(timeout_ms, &deadline);
+    if (mq_timedreceive(this->mqd, (char*) &msg, sizeof(msg_t), &aux, &deadline) == -1) {
+        if (errno != ETIMEDOUT) {
+            perror(ERROR("mq_timedreceive in PosixMsgQueue::read_timed"));
+        }
+        return -1;
+    }
+    if (priority != NULL) {
+        *priority = (long) aux;
+    }
+    return 0;
+}
+
+/// @brief Not supported by POSIX queues: kept for compatibility with MsgQueue.
+/// @param status If not NULL, loaded with "ENOTSUP".
+/// @return A message filled with zeros.
+template <class msg_t>
+msg_t PosixMsgQueue<msg_t>::peek(int index, int* status) {
+    msg_t output;
+    memset(&output, 0, sizeof(output));
+    if (status != NULL) {
+        *status = ENOTSUP;
+    }
+    return output;
+}
+
+/// @brief Returns the amount of messages in the queue, or "-1" on error.
+template <class msg_t>
+int PosixMsgQueue<msg_t>::get_msg_qtty(void) {
+    struct mq_attr attr;
+    if (mq_getattr(this->mqd, &attr) == -1) {
+        perror(ERROR("mq_getattr in PosixMsgQueue::get_msg_qtty"));
+        return -1;
+    }
+    return (int) attr.mq_curmsgs;
+}
+
+/// @brief Returns the descriptor of the queue, to wait on it with epoll or a
+///  Poller: "EPOLLIN" when it has messages, and "EPOLLOUT" when it has room.
+template <class msg_t>
+int PosixMsgQueue<msg_t>::get_fd(void) const {
+    return (int) this->mqd;
+}
+
+/// @brief Returns "true" if the queue is empty, "false" otherwise.
+template <class msg_t>
+bool PosixMsgQueue<msg_t>::is_empty(void) {
+    return (this->get_msg_qtty() == 0);
+}
+
+/// @brief Returns "true" if there is at least one message in the queue,
+///  "false" otherwise.
+template <class msg_t>
+bool PosixMsgQueue<msg_t>::has_msg(void) {
+    return (this->get_msg_qtty() > 0);
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Builds the name of the queue from the key of "path" and "id". Left
+///  empty if ftok() fails.
+template <class msg_t>
+void PosixMsgQueue<msg_t>::make_name(const char* path, int id, char* name) {
+    key_t key;
+    name[0] = '\0';
+    if ( (key = ftok(path, id) ) != -1) {
+        snprintf(name, 32, "/ipc_%08x", (unsigned int) key);
+    }
+}
+
+/// @brief Clamps "mtype" to a valid priority.
+template <class msg_t>
+unsigned int PosixMsgQueue<msg_t>::get_priority(long mtype) {
+    if (mtype < 0) {
+        return 0;
+    }
+    return (mtype >= MQ_PRIO_MAX) ? MQ_PRIO_MAX - 1 : (unsigned int) mtype;
+}
+
+/// @brief Absolute time, in "CLOCK_REALTIME" as the queues use, "timeout_ms"
+///  milliseconds from now.
+template <class msg_t>
+void PosixMsgQueue<msg_t>::get_deadline(int timeout_ms, struct timespec* deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/******************************************************************************
+ * Overloaded operators
+******************************************************************************/
+
+/// @brief Sends a message with priority "1". Might throw "std::runtime_error".
+template <class msg_t>
+PosixMsgQueue<msg_t>& PosixMsgQueue<msg_t>::operator<<(msg_t msg) {
+    if (this->write(msg, 1) == -1) {
+        throw(std::runtime_error("PosixMsgQueue::operator<<"));
+    }
+    return *this;
+}
+
+/// @brief Reads the first message on the queue. Might throw "std::runtime_error".
+template <class msg_t>
+PosixMsgQueue<msg_t>& PosixMsgQueue<msg_t>::operator>>(msg_t& msg) {
+    if (this->read_into(msg) == -1) {
+        throw(std::runtime_error("PosixMsgQueue::operator>>"));
+    }
+    return *this;
+}
+
+#endif // POSIX_MSG_QUEUE_H
@@ -0,0 +1,68 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "mutex.h"
+#include "thread.h"
+#include "tools.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/// @brief Process-wide cache of "getaddrinfo()" results, shared by every
+///  Socket. Successful lookups are kept for "ttl" milliseconds, and failed
+///  ones for "negative_ttl", so a host that doesn't resolve is not looked up
+///  again on every try. Expired lookups are removed when a new one is stored.
+///  Lookups can also run on a helper thread, so hot paths only ever read the
+///  cache.
+class Resolver {
+public:
+    struct Address {
+        int family;
+        int socktype;
+        int protocol;
+        struct sockaddr_storage addr;
+        socklen_t addrlen;
+    };
+    typedef void (*Callback)(int status, const std::vector<Address>& addrs, void* args);
+
+private:
+    struct Entry {
+        int status;
+        std::vector<Address> addrs;
+        long long expires;      // CLOCK_MONOTONIC, in milliseconds.
+    };
+    struct Request {
+        std::string host;
+        bool null_host;
+        std::string port;
+        bool null_port;
+        int family;
+        int socktype;
+        Callback on_resolved;
+        void* args;
+    };
+    static std::map<std::string, Entry> cache;
+    static Mutex mutex;
+    static int ttl, negative_ttl;
+    static std::string get_key(const char* host, const char* port, int family, int socktype);
+    static bool lookup(const std::string& key, std::vector<Address>& addrs, int& status);
+    static void evict(void);
+    static long long now(void);
+    static void* run_request(void* request);
+
+public:
+    static int resolve(const char* host, const char* port, int family, int socktype, std::vector<Address>& addrs);
+    static int resolve_async(const char* host, const char* port, int family, int socktype,
+        Callback on_resolved=NULL, void* args=NULL);
+    static bool is_cached(const char* host, const char* port, int family, int socktype);
+    static void set_ttl(int ttl, int negative_ttl);
+    static void clear(void);
+};
+
+#endif // RESOLVER_H
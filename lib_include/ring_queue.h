@@ -0,0 +1,306 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "shared_memory.h"
+#include "tools.h"
+#include <stdexcept>
+#include <errno.h>
+#include <unistd.h>
+#include <atomic>
+#include <type_traits>
+
+/// @brief Queue of messages between exactly one producer and one consumer,
+///  processes or threads of the same host, over a ring in a SharedMemory
+///  segment. Messages are copied straight into the ring, so writes and reads
+///  don't make a system call unless the ring is empty or full, when the
+///  blocked side sleeps on a futex until the other one wakes it up. It has the
+///  FIFO interface of MsgQueue; there are no message types.
+/// @tparam msg_t Type of the message. It must be trivially copyable, and with
+///  the same restrictions of MsgQueue.
+template <class msg_t>
+class RingQueue {
+private:
+    /// @brief Start of the segment. Each index is written by one side only, and
+    ///  lives in its own cache line, so the sides don't invalidate each other's
+    ///  line on every message.
+    struct Control {
+        alignas(64) std::atomic<uint32_t> head;     // Next to read. Consumer.
+        std::atomic<uint32_t> producer_waiting;     // Producer sleeps on "head".
+        alignas(64) std::atomic<uint32_t> tail;     // Next to write. Producer.
+        std::atomic<uint32_t> consumer_waiting;     // Consumer sleeps on "tail".
+        alignas(64) uint32_t capacity;              // Power of 2.
+        std::atomic<uint32_t> ready;                // "RING_QUEUE_MAGIC" when set.
+    };
+    static const uint32_t RING_QUEUE_MAGIC = 0x52494e47;
+    static const int SPIN_COUNT = 128;
+    SharedMemory<char> shm;
+    Control* control;
+    msg_t* slots;
+    uint32_t mask;
+    uint32_t cached_head;   // Last "head" seen by the producer.
+    uint32_t cached_tail;   // Last "tail" seen by the consumer.
+    static size_t segment_size(bool create, int capacity);
+    static int futex_wait(std::atomic<uint32_t>* addr, uint32_t value);
+    static void futex_wake(std::atomic<uint32_t>* addr);
+    int wait_for(std::atomic<uint32_t>& index, uint32_t value, std::atomic<uint32_t>& waiting);
+
+public:
+    RingQueue(const char* path, int id, bool create=false, int capacity=1024);
+    bool static exists(const char* path, int id);
+    int write(const msg_t& msg, long mtype=1, int flags=0);
+    msg_t read(int mtype=0, int* status=NULL, int flags=0);
+    int read_into(msg_t& msg, long mtype=0, int flags=0);
+    int get_msg_qtty(void);
+    int get_capacity(void) const;
+    bool is_empty(void);
+    bool has_msg(void);
+    RingQueue& operator<<(msg_t msg);
+    RingQueue& operator>>(msg_t& msg);
+};
+
+/******************************************************************************
+ * Template functions
+******************************************************************************/
+
+/// @brief Creates a ring queue, or connects to an existing one.
+/// @param path Can be any path. Identifier for the queue.
+/// @param id Can be any number. Identifier for the queue.
+/// @param create If "true", create the queue. If "false", connect to an
+///  already existing one.
+/// @param capacity Most messages the ring holds, rounded up to a power of 2.
+///  Only used with "create" (1024 by default).
+/// @return If error, throws an exception with std::runtime_error
+template <class msg_t>
+RingQueue<msg_t>::RingQueue(const char* path, int id, bool create, int capacity):
+    shm(path, id, segment_size(create, capacity)) {
+    static_assert(std::is_trivially_copyable<msg_t>::value, "RingQueue messages must be trivially copyable");
+    this->control = (Control*) &this->shm[0];
+    if (create) {
+        this->control->capacity = (uint32_t) (segment_size(true, capacity) - sizeof(Control)) / sizeof(msg_t);
+        this->control->head.store(0, std::memory_order_relaxed);
+        this->control->tail.store(0, std::memory_order_relaxed);
+        this->control->producer_waiting.store(0, std::memory_order_relaxed);
+        this->control->consumer_waiting.store(0, std::memory_order_relaxed);
+        this->control->ready.store(RING_QUEUE_MAGIC, std::memory_order_release);
+    } else if (this->control->ready.load(std::memory_order_acquire) != RING_QUEUE_MAGIC) {
+        fprintf(stderr, ERROR("Segment is not an initialized ring in RingQueue::RingQueue\n"));
+        throw(std::runtime_error("RingQueue"));
+    }
+    this->slots = (msg_t*) (this->control + 1);
+    this->mask = this->control->capacity - 1;
+    this->cached_head = this->control->head.load(std::memory_order_acquire);
+    this->cached_tail = this->control->tail.load(std::memory_order_acquire);
+}
+
+/// @brief Checks if the queue already exists.
+/// @return "true" if it exists, "false" otherwise.
+template <class msg_t>
+bool RingQueue<msg_t>::exists(const char* path, int id) {
+    return SharedMemory<char>::exists(path, id);
+}
+
+/// @brief Writes a message in the queue. Only one thread or process may write.
+/// @param msg Message to be written.
+/// @param mtype Ignored, kept for compatibility with MsgQueue (default "1").
+/// @param flags "IPC_NOWAIT" to fail with errno "EAGAIN" instead of blocking
+///  when the ring is full ("0" by default).
+/// @return "0" on success, "-1" on error.
+template <class msg_t>
+int RingQueue<msg_t>::write(const msg_t& msg, long mtype, int flags) {
+    uint32_t tail = this->control->tail.load(std::memory_order_relaxed);
+    if (tail - this->cached_head > this->mask) {
+        this->cached_head = this->control->head.load(std::memory_order_acquire);
+        while (tail - this->cached_head > this->mask) {
+            if (flags & IPC_NOWAIT) {
+                errno = EAGAIN;
+                return -1;
+            }
+            if (this->wait_for(this->control->head, this->cached_head, this->control->producer_waiting) == -1) {
+                return -1;
+            }
+            this->cached_head = this->control->head.load(std::memory_order_acquire);
+        }
+    }
+    this->slots[tail & this->mask] = msg;
+    this->control->tail.store(tail + 1, std::memory_order_seq_cst);
+    if (this->control->consumer_waiting.load(std::memory_order_seq_cst)) {
+        futex_wake(&this->control->tail);
+    }
+    return 0;
+}
+
+/// @brief Reads the first message of the queue. By default, in a blocking
+///  manner. Only one thread or process may read.
+/// @param mtype Must be "0": the ring is FIFO only.
+/// @param status If not NULL, it will be loaded with a "0" on success, or with
+///  the "errno" value in case of error.
+/// @param flags "IPC_NOWAIT" for a non-blocking read ("0" by default).
+/// @return The message read.
+template <class msg_t>
+msg_t RingQueue<msg_t>::read(int mtype, int* status, int flags) {
+    msg_t output;
+    int error_state = 0;
+    memset(&output, 0, sizeof(output));
+    if (this->read_into(output, mtype, flags) == -1) {
+        error_state = errno;
+    }
+    if (status != NULL) {
+        *status = error_state;
+    }
+    return output;
+}
+
+/// @brief Reads the first message of the queue into "msg".
+/// @param msg Where the message will be stored.
+/// @param mtype Must be "0": the ring is FIFO only.
+/// @param flags "IPC_NOWAIT" for a non-blocking read ("0" by default).
+/// @return "0" on success, "-1" on error. "-1" with errno "ENOMSG" if there
+///  was no message with "IPC_NOWAIT", as in MsgQueue.
+template <class msg_t>
+int RingQueue<msg_t>::read_into(msg_t& msg, long mtype, int flags) {
+    uint32_t head = this->control->head.load(std::memory_order_relaxed);
+    if (mtype != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (head == this->cached_tail) {
+        this->cached_tail = this->control->tail.load(std::memory_order_acquire);
+        while (head == this->cached_tail) {
+            if (flags & IPC_NOWAIT) {
+                errno = ENOMSG;
+                return -1;
+            }
+            if (this->wait_for(this->control->tail, this->cached_tail, this->control->consumer_waiting) == -1) {
+                return -1;
+            }
+            this->cached_tail = this->control->tail.load(std::memory_order_acquire);
+        }
+    }
+    msg = this->slots[head & this->mask];
+    this->control->head.store(head + 1, std::memory_order_seq_cst);
+    if (this->control->producer_waiting.load(std::memory_order_seq_cst)) {
+        futex_wake(&this->control->head);
+    }
+    return 0;
+}
+
+/// @brief Returns the amount of messages in the queue.
+template <class msg_t>
+int RingQueue<msg_t>::get_msg_qtty(void) {
+    uint32_t head = this->control->head.load(std::memory_order_acquire);
+    return (int) (this->control->tail.load(std::memory_order_acquire) - head);
+}
+
+/// @brief Returns the most messages the ring holds.
+template <class msg_t>
+int RingQueue<msg_t>::get_capacity(void) const {
+    return (int) this->control->capacity;
+}
+
+/// @brief Returns "true" if the queue is empty, "false" otherwise.
+template <class msg_t>
+bool RingQueue<msg_t>::is_empty(void) {
+    return (this->get_msg_qtty() == 0);
+}
+
+/// @brief Returns "true" if there is at least one message in the queue,
+///  "false" otherwise.
+template <class msg_t>
+bool RingQueue<msg_t>::has_msg(void) {
+    return (this->get_msg_qtty() > 0);
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Bytes of the segment: the control block and the slots. "0" to
+///  connect to an existing one.
+template <class msg_t>
+size_t RingQueue<msg_t>::segment_size(bool create, int capacity) {
+    size_t slots = 1;
+    if (!create) {
+        return 0;
+    }
+    if (capacity <= 0 || capacity > (1 << 30)) {
+        fprintf(stderr, ERROR("Capacity must be between 1 and 2^30 in RingQueue::RingQueue\n"));
+        throw(std::runtime_error("RingQueue"));
+    }
+    while (slots < (size_t) capacity) {
+        slots <<= 1;
+    }
+    return sizeof(Control) + slots * sizeof(msg_t);
+}
+
+/// @brief Sleeps while "*addr" is "value", shared between processes.
+/// @return "0" when woken up or if "*addr" changed, "-1" on error.
+template <class msg_t>
+int RingQueue<msg_t>::futex_wait(std::atomic<uint32_t>* addr, uint32_t value) {
+    if (syscall(SYS_futex, (uint32_t*) addr, FUTEX_WAIT, value, NULL, NULL, 0) == -1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            perror(ERROR("futex in RingQueue::futex_wait"));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Wakes up the side sleeping on "addr".
+template <class msg_t>
+void RingQueue<msg_t>::futex_wake(std::atomic<uint32_t>* addr) {
+    if (syscall(SYS_futex, (uint32_t*) addr, FUTEX_WAKE, 1, NULL, NULL, 0) == -1) {
+        perror(ERROR("futex in RingQueue::futex_wake"));
+    }
+}
+
+/// @brief Waits until the other side moves "index" away from "value": spins a
+///  little, then flags "waiting" and sleeps. The other side stores its index
+///  before checking the flag, and this one the flag before checking the index,
+///  so a wake up can't be lost.
+/// @return "0" when "index" may have changed, "-1" on error.
+template <class msg_t>
+int RingQueue<msg_t>::wait_for(std::atomic<uint32_t>& index, uint32_t value, std::atomic<uint32_t>& waiting) {
+    int status = 0;
+    for (int i = 0; i < SPIN_COUNT; i++) {
+        if (index.load(std::memory_order_acquire) != value) {
+            return 0;
+        }
+    }
+    waiting.store(1, std::memory_order_seq_cst);
+    if (index.load(std::memory_order_seq_cst) == value) {
+        status = futex_wait(&index, value);
+    }
+    waiting.store(0, std::memory_order_relaxed);
+    return status;
+}
+
+/******************************************************************************
+ * Overloaded operators
+******************************************************************************/
+
+/// @brief Writes a message. Might throw "std::runtime_error".
+template <class msg_t>
+RingQueue<msg_t>& RingQueue<msg_t>::operator<<(msg_t msg) {
+    if (this->write(msg) == -1) {
+        throw(std::runtime_error("RingQueue::operator<<"));
+    }
+    return *this;
+}
+
+/// @brief Reads the first message of the queue. Might throw "std::runtime_error".
+template <class msg_t>
+RingQueue<msg_t>& RingQueue<msg_t>::operator>>(msg_t& msg) {
+    if (this->read_into(msg) == -1) {
+        throw(std::runtime_error("RingQueue::operator>>"));
+    }
+    return *this;
+}
+
+#endif // RING_QUEUE_H
@@ -3,11 +3,23 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <sched.h>
 #include <stdio.h>
 #include "socket.h"
 #include "sig.h"
+#include "thread.h"
+#include "uring.h"
 #include "tools.h"
 #include <errno.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <vector>
 
 /// @brief Abstract class. The user should inherit from this class and can:
 ///  * Modify the constructor, as long as the parent constructor is called in the
@@ -16,12 +28,94 @@
 ///  * Override the on_start() function to make something right before accepting connections.
 ///  * Override the on_new_client() function to make something right after accepting a new connection.
 ///  * Override the on_quit() function to make some cleanups after the server exits.
-///  The server stops execution after receiving a SIGINT.
+///  * Override on_readable(), on_writable() and on_close() to handle clients
+///  when running with start_event_loop() instead of start().
+///  * Override on_recv() to handle clients when running with start_uring().
+///  * Override on_datagram() to handle packets when the server was created
+///  with "SOCK_DGRAM". start() runs start_datagram() for these servers.
+///  * Run start_prefork() or start_threaded() instead of start() to attend
+///  clients with a fixed pool of worker processes or threads, as long as the
+///  server was created with "reuse_port".
+///  The server stops execution after calling stop(), or after receiving a
+///  SIGINT, which stops every server in the process.
 class Server {
 private:
+    /// @brief Entry of the list of servers stopped by leave() on SIGINT. Entries
+    ///  are never freed, and one left empty by a destroyed server is reused, so
+    ///  the handler can walk the list at any time without locks.
+    struct Instance {
+        std::atomic<Server*> server;
+        Instance* next;
+    };
+    struct Reactor {
+        Server* server;
+        int epfd;
+        int max_events;
+        std::set<Socket*> clients;
+        std::vector<Socket*> closed;    // Freed after the current batch of events.
+    };
+    struct Worker {
+        Server* server;
+        int index;
+        bool pin_cpu;
+    };
+    struct UringClient {
+        Socket* socket;
+        int inflight;       // Operations in the ring.
+        bool closing;
+        bool writing;
+        int pending;        // Bytes in the write buffer.
+    };
+    struct UringLoop {
+        URing* ring;
+        std::vector<UringClient> clients;
+        std::vector<int> free_slots;
+        std::map<Socket*, int> slots;
+        std::vector<char> buffers;
+        int buffer_size;
+        bool multishot;
+        bool accepting;     // The accept is still in the ring.
+        struct __kernel_timespec drain;     // Time to send the last replies.
+    };
+    struct Datagrams {
+        std::vector<struct mmsghdr> msgs_in, msgs_out;
+        std::vector<struct iovec> iov_in, iov_out;
+        std::vector<struct sockaddr_storage> addr_in, addr_out;
+        std::vector<char> buffers_in, buffers_out;
+        int buffer_size;
+        int pending;        // Replies in "msgs_out".
+    };
     Socket socket;
     int backlog;
-    static bool exit;
+    int stop_fd;
+    int recv_size;
+    std::atomic<bool> exit;
+    Instance* instance;
+    static std::atomic<Instance*> instances;
+    static std::atomic<int> leaving;    // Handlers running leave().
+    static thread_local Reactor* current_reactor;
+    static thread_local UringLoop* current_uring;
+    static thread_local Datagrams* current_datagrams;
+
+    static void* run_reactor(void* reactor);
+    void reactor_loop(Reactor* reactor);
+    void accept_clients(Reactor* reactor);
+    static void free_closed(Reactor* reactor);
+    void uring_loop(UringLoop* loop);
+    void uring_complete(UringLoop* loop, uint64_t user_data, int res, unsigned flags);
+    void uring_new_client(UringLoop* loop, int sockfd);
+    void uring_read(UringLoop* loop, int slot);
+    void uring_write(UringLoop* loop, int slot);
+    void uring_release(UringLoop* loop, int slot);
+    bool uring_writing(UringLoop* loop);
+    int flush_datagrams(Datagrams* datagrams);
+    bool has_reuse_port(void);
+    void register_instance(void);
+    int init_client(Socket& client, int sockfd, struct sockaddr* addr, socklen_t addrlen);
+    int wait_client(Socket& listener, const sigset_t* sigmask=NULL);
+    void serve(Socket& listener);
+    static void* run_thread(void* worker);
+    void run_worker(int index, bool pin_cpu);
 
 protected:
     // Define this function to handle clients' connections.
@@ -33,12 +127,40 @@ protected:
     virtual void on_new_client(void) {};
     // Override this function to make some cleanups after the server exits.
     virtual void on_quit(void) {};
+    // Event loop mode only. Override to read from a client that has data
+    // available. Call close_client() when "read()" returns "0".
+    virtual void on_readable(Socket& socket) {};
+    // Event loop mode only. Override to write to a client whose socket buffer
+    // has room again. Only called after want_write(socket, true).
+    virtual void on_writable(Socket& socket) {};
+    // Event loop and io_uring modes. Override to make something right before
+    // a client connection is closed and released.
+    virtual void on_close(Socket& socket) {};
+    // io_uring mode only. Override to handle "len" bytes received from a
+    // client, which are only valid during the call. Reply with queue_write().
+    virtual void on_recv(Socket& socket, void* data, int len) {};
+    // Datagram mode only. Override to handle a packet of "len" bytes sent
+    // from "peer", only valid during the call. Reply with queue_datagram().
+    virtual void on_datagram(void* data, int len, struct sockaddr* peer, socklen_t peer_len) {};
 
+    int want_write(Socket& socket, bool enable=true);
+    int queue_write(Socket& socket, const void* data, int len);
+    int queue_datagram(const void* data, int len, const struct sockaddr* peer, socklen_t peer_len);
+    void close_client(Socket& socket);
     static void leave(int);
 
 public:
-    Server(const char* ip, const char* port, int family=AF_UNSPEC, int socktype=SOCK_STREAM);
+    Server(const char* ip, const char* port, int family=AF_UNSPEC, int socktype=SOCK_STREAM, bool reuse_port=false,
+        SocketProfile profile=SOCKET_PROFILE_DEFAULT);
+    virtual ~Server();
     void start(int backlog=20);
+    void start_event_loop(int backlog=SOMAXCONN, int reactors=1, int max_events=64);
+    void start_prefork(int workers, int backlog=20, bool pin_cpu=false);
+    void start_threaded(int threads=0, int backlog=20, bool pin_cpu=true);
+    void start_uring(int backlog=SOMAXCONN, int max_clients=256, int buffer_size=4096);
+    void start_datagram(int batch=64, int buffer_size=2048);
+    void stop(void);
+    int set_fastopen(int qlen=16);
     Socket& get_socket(void);
 };
 
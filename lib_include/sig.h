@@ -12,8 +12,9 @@ namespace Signal {
     int set_handler (int signal, void(*signal_handler)(int), int flags=0, int* signals_blocked_in_handler=NULL, int size=0);
     int ignore(int signal);
     int set_default_handler(int signal);
-    int block(int signal);
+    int block(int signal, sigset_t* old_mask=NULL);
     int unblock(int signal);
+    int restore_mask(const sigset_t* old_mask);
     int unblock_all(void);
     int kill (pid_t pid, int signal);
     int kill (pthread_t thread_id, int signal);
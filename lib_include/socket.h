@@ -3,48 +3,192 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <stddef.h>
 #include <netdb.h>
 #include <string.h>
 #include <stdio.h>
+#include "resolver.h"
 #include "tools.h"
 #include <stdexcept>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <utility>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef MSG_FASTOPEN
+#define MSG_FASTOPEN 0x20000000
+#endif
+#ifndef TCP_FASTOPEN
+#define TCP_FASTOPEN 23
+#endif
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#include <vector>
+
+/// @brief Message made of several fields, sent with a single Socket::writev().
+///  Strings and buffers added with add() are not copied, so they must stay
+///  valid until the message is sent. Numbers and characters are copied.
+class SocketMsg {
+private:
+    struct Field {
+        const void* data;   // NULL if the field is stored in "values".
+        size_t offset;
+        size_t len;
+    };
+    std::vector<Field> fields;
+    std::vector<char> values;
+    std::vector<struct iovec> iov;
+    SocketMsg& add_value(const void* data, size_t len);
+
+public:
+    SocketMsg& add(const void* data, size_t len);
+    void clear(void);
+    size_t get_len(void) const;
+    struct iovec* get_iov(void);
+    int get_iovcnt(void) const;
+
+    SocketMsg& operator<< (const char* a);
+    SocketMsg& operator<< (int a);
+    SocketMsg& operator<< (char a);
+};
+
+/// @brief Sets of socket options for Socket::set_profile().
+///  * SOCKET_PROFILE_DEFAULT; Options of the kernel: Nagle's algorithm and
+///  delayed ACKs.
+///  * SOCKET_PROFILE_LATENCY; For small requests and responses: "TCP_NODELAY",
+///  "TCP_QUICKACK" after every read, "SO_BUSY_POLL" and small buffers, so
+///  little data waits in queues.
+///  * SOCKET_PROFILE_THROUGHPUT; For bulk transfers: "TCP_CORK", so only full
+///  segments are sent, and large buffers.
+enum SocketProfile {
+    SOCKET_PROFILE_DEFAULT,
+    SOCKET_PROFILE_LATENCY,
+    SOCKET_PROFILE_THROUGHPUT
+};
+
+// Size of a Unix domain socket path, with its null terminator.
+#define UNIX_ADDRSTRLEN (sizeof(((struct sockaddr_un*) 0)->sun_path) + 1)
 
 class Socket {
 private:
     int sockfd;
-    char my_ip [INET6_ADDRSTRLEN], peer_ip [INET6_ADDRSTRLEN];
-    int my_port, peer_port;
-    int get_ip_from_sockfd(int sockfd, char* ip);
-    int get_port_from_sockfd(int sockfd);
-    int get_ip_from_sockaddr(char* ip, struct sockaddr* sa);
-    int get_port_from_sockaddr(struct sockaddr* sa);
+    // Address of the peer, or the own one for servers. IPs and paths are only
+    // formatted when asked for.
+    struct sockaddr_storage peer_addr;
+    socklen_t peer_addrlen;
+    bool zerocopy;
+    int zerocopy_min;
+    uint32_t zerocopy_next;     // ID of the next zero-copy send.
+    uint32_t zerocopy_pending;  // Zero-copy sends not completed yet.
+    SocketProfile profile;
+    int busy_poll;              // Microseconds spinning in read(), "0" if disabled.
+    bool quickack;              // Set "TCP_QUICKACK" again after each read().
+    pid_t path_owner;           // Process that bound the socket file, "0" if none.
+    static int get_ip_from_sockaddr(char* ip, const struct sockaddr* sa);
+    static int get_port_from_sockaddr(const struct sockaddr* sa);
+    static void get_path_from_sockaddr(char* path, const struct sockaddr* sa, socklen_t addrlen);
+    int get_my_addr(struct sockaddr_storage* addr, socklen_t* addrlen) const;
+    void set_peer_addr(const struct sockaddr* addr, socklen_t addrlen);
+    void init_unix(const char* path, int socktype, bool server);
+    void remove_path(void);
+    static int get_unix_addr(const char* path, struct sockaddr_un* addr, socklen_t* addrlen);
+    bool is_tcp(void);
+    int read_busy_poll(void* msg, int len, int flags);
 
 public:
-    Socket(const char* ip, const char* port, int family=AF_UNSPEC, int socktype=SOCK_STREAM, bool server=false);
-    Socket(const Socket& socket);
+    Socket(const char* ip, const char* port, int family=AF_UNSPEC, int socktype=SOCK_STREAM, bool server=false, bool reuse_port=false,
+        SocketProfile profile=SOCKET_PROFILE_DEFAULT);
+    Socket(const Socket& socket) = delete;
+    Socket(Socket&& socket);
     Socket();
-    int init (int sockfd, struct sockaddr* addr);
+    Socket& operator= (const Socket& socket) = delete;
+    Socket& operator= (Socket&& socket);
+    int init (int sockfd, struct sockaddr* addr, socklen_t addrlen=0);
+    int connect(const char* ip, const char* port, int timeout_ms, int family=AF_UNSPEC, int socktype=SOCK_STREAM, int stagger_ms=250);
+    int connect_fastopen(const char* ip, const char* port, const void* data, int len, int family=AF_UNSPEC);
     static bool is_listening(const char* ip, const char* port, int family=AF_UNSPEC, int socktype=SOCK_STREAM);
     void close(void);
     ~Socket();
 
     int write(void* msg, int len, int flags=0);
     int read(void* msg, int len, int flags=0);
+    int read_timestamped(void* msg, int len, struct timespec* ts, int flags=0);
+    int writev(const struct iovec* iov, int iovcnt, int flags=0);
+    int readv(const struct iovec* iov, int iovcnt, int flags=0);
+    int write_msg(const struct msghdr* msg, int flags=0);
+    ssize_t send_file(int fd, off_t offset, size_t len);
+    int write_batch(struct mmsghdr* msgs, int vlen, int flags=0);
+    int read_batch(struct mmsghdr* msgs, int vlen, int flags=0);
+    int set_nonblocking(bool nonblocking=true);
+    int set_zerocopy(bool enable=true, int min_len=16384);
+    int set_profile(SocketProfile profile, int buffer_size=0);
+    void inherit_profile(const Socket& listener);
+    int set_busy_poll(int usec);
+    int set_cork(bool enable=true);
+    int set_fastopen(int qlen=16);
+    int set_timestamping(bool rx=true, bool tx=true);
+    int get_fastopen(void) const;
+    int poll_completions(void (*on_complete)(uint32_t first, uint32_t last, bool copied, void* args)=NULL,
+        void* args=NULL, int timeout=0,
+        void (*on_timestamp)(uint32_t id, int type, const struct timespec* ts, void* args)=NULL);
+    uint32_t get_zerocopy_id(void) const;
+    uint32_t get_zerocopy_pending(void) const;
+    SocketProfile get_profile(void) const;
+    int get_busy_poll(void) const;
 
     int get_sockfd(void) const;
     void get_peer_ip(char* ip) const;
     int get_peer_port(void) const;
     void get_my_ip(char* ip) const;
     int get_my_port(void) const;
+    void get_path(char* path) const;
 
     Socket& operator<< (const char* a);
     Socket& operator<< (int a);
     Socket& operator<< (char a);
+    Socket& operator<< (SocketMsg& a);
     Socket& operator>> (int &a);
     Socket& operator>> (char &a);
 };
 
+/// @brief Moves the bytes received on one Socket to another one through a
+///  pipe, with "splice()", so they are never copied to user memory. Used to
+///  proxy between two connections. Both sockets must outlive the relay.
+class Relay {
+private:
+    Socket& from;
+    Socket& to;
+    int pipefd[2];
+    size_t pipe_size;
+    size_t pending;     // Bytes in the pipe, not sent yet.
+
+public:
+    Relay(Socket& from, Socket& to, size_t pipe_size=65536);
+    ~Relay();
+    ssize_t transfer(void);
+    size_t get_pending(void) const;
+};
+
 #endif // SOCKET_H
@@ -0,0 +1,50 @@
+#ifndef SOCKET_POOL_H
+#define SOCKET_POOL_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <time.h>
+#include "socket.h"
+#include "mutex.h"
+#include "tools.h"
+#include <errno.h>
+#include <deque>
+#include <map>
+#include <string>
+
+/// @brief Thread-safe pool of connected client sockets, kept per
+///  (ip, port, family). acquire() hands out an idle connection if there is a
+///  live one, or connects a new one; release() gives it back for the next
+///  request. Idle connections are closed after "idle_timeout" milliseconds.
+class SocketPool {
+private:
+    struct Idle {
+        Socket* socket;
+        long long since;    // CLOCK_MONOTONIC, in milliseconds.
+    };
+    struct Bucket {
+        std::deque<Idle> idle;  // The most recent one at the back.
+        int total;              // Idle and in use.
+    };
+    std::map<std::string, Bucket> buckets;
+    std::map<Socket*, std::string> in_use;
+    Mutex mutex;
+    int max_idle, max_total;
+    int idle_timeout, connect_timeout;
+    static std::string get_key(const char* ip, const char* port, int family);
+    static long long now(void);
+    static bool is_alive(Socket* socket);
+    int evict_bucket(Bucket& bucket, long long now);
+
+public:
+    SocketPool(int max_idle=8, int max_total=64, int idle_timeout=60000, int connect_timeout=5000);
+    ~SocketPool();
+    Socket* acquire(const char* ip, const char* port, int family=AF_UNSPEC);
+    void release(Socket* socket, bool reusable=true);
+    int evict(void);
+    int get_idle(const char* ip, const char* port, int family=AF_UNSPEC);
+    int get_total(const char* ip, const char* port, int family=AF_UNSPEC);
+};
+
+#endif // SOCKET_POOL_H
@@ -0,0 +1,52 @@
+#ifndef SOCKET_STREAM_H
+#define SOCKET_STREAM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include "socket.h"
+#include "tools.h"
+#include <errno.h>
+#include <stdexcept>
+#include <vector>
+
+/// @brief Buffered stream over a connected Socket. Small reads are served from
+///  a read buffer filled with as few "recv()" as possible, and small writes
+///  are gathered in a write buffer, sent when it reaches the flush threshold
+///  or when flush() is called. Also extracts frames ended by a delimiter or
+///  prefixed with their length. The Socket must outlive the stream.
+class SocketStream {
+private:
+    Socket& socket;
+    std::vector<char> read_buffer;
+    int read_start, read_end;
+    std::vector<char> write_buffer;
+    int write_len;
+    int flush_threshold;
+    int fill(void);
+
+public:
+    SocketStream(Socket& socket, int read_size=4096, int write_size=4096, int flush_threshold=0);
+    ~SocketStream();
+
+    int read(void* msg, int len);
+    int read_exact(void* msg, int len);
+    int read_until(char delimiter, void* frame, int max_len);
+    int read_frame(void* frame, int max_len);
+    int write(const void* msg, int len);
+    int write_all(const void* msg, int len);
+    int write_frame(const void* frame, int len);
+    int flush(void);
+
+    int get_buffered(void) const;
+    int get_pending(void) const;
+    Socket& get_socket(void);
+
+    SocketStream& operator<< (const char* a);
+    SocketStream& operator<< (int a);
+    SocketStream& operator<< (char a);
+    SocketStream& operator>> (int &a);
+    SocketStream& operator>> (char &a);
+};
+
+#endif // SOCKET_STREAM_H
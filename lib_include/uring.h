@@ -0,0 +1,66 @@
+#ifndef URING_H
+#define URING_H
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "tools.h"
+#include <stdexcept>
+#include <errno.h>
+#include <unistd.h>
+
+// Older kernel headers don't define the multishot accept flags.
+#ifndef IORING_ACCEPT_MULTISHOT
+#define IORING_ACCEPT_MULTISHOT (1U << 0)
+#endif
+#ifndef IORING_CQE_F_MORE
+#define IORING_CQE_F_MORE (1U << 1)
+#endif
+
+/// @brief Minimal io_uring instance, used through the raw system calls.
+///  Operations are prepared with the prep_*() functions, sent to the kernel
+///  all at once with submit(), and their results are read with peek() and
+///  seen(), in completion order.
+class URing {
+private:
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned sqe_tail;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ptr;
+    void* cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+
+    struct io_uring_sqe* get_sqe(void);
+
+public:
+    URing(unsigned entries=256);
+    ~URing();
+    static bool is_supported(void);
+
+    int submit(unsigned wait_nr=0);
+    struct io_uring_cqe* peek(void);
+    void seen(void);
+    int register_buffers(struct iovec* buffers, unsigned nr);
+
+    int prep_accept(int sockfd, bool multishot, uint64_t user_data);
+    int prep_recv(int sockfd, void* buf, size_t len, int flags, uint64_t user_data);
+    int prep_send(int sockfd, const void* buf, size_t len, int flags, uint64_t user_data);
+    int prep_read_fixed(int fd, void* buf, size_t len, int buf_index, uint64_t user_data);
+    int prep_write_fixed(int fd, const void* buf, size_t len, int buf_index, uint64_t user_data);
+    int prep_poll(int fd, short events, uint64_t user_data);
+    int prep_timeout(const struct __kernel_timespec* ts, uint64_t user_data);
+    int prep_cancel(uint64_t target, uint64_t user_data);
+};
+
+#endif // URING_H
@@ -0,0 +1,258 @@
+#include "async_socket.h"
+
+/******************************************************************************
+ * Constructors and destructors
+******************************************************************************/
+
+/// @brief Creates an asynchronous writer over a connected socket, and sets the
+///  socket in non-blocking mode.
+/// @param socket Connected socket. It's not closed by this object.
+/// @param high_watermark When this amount of bytes is queued, "on_high" is
+///  called, see set_watermark_callbacks().
+/// @param low_watermark When the queue drains to this amount of bytes after
+///  reaching the high watermark, "on_low" is called.
+/// @param max_pending Most bytes queued. Writes that don't fit are refused.
+/// @return Might throw std::runtime_error on error.
+AsyncSocket::AsyncSocket(Socket& socket, int high_watermark, int low_watermark, int max_pending):
+    socket(socket), pending(0), high_watermark(high_watermark), low_watermark(low_watermark),
+    max_pending(max_pending), high(false), error(0), on_high(NULL), on_low(NULL), watermark_args(NULL),
+    poller(NULL), events(0), writing(false) {
+    if (low_watermark < 0 || low_watermark > high_watermark || high_watermark > max_pending) {
+        fprintf(stderr, ERROR("Watermarks must be 0 <= low <= high <= max in AsyncSocket::AsyncSocket\n"));
+        throw(std::runtime_error("AsyncSocket"));
+    }
+    if (this->socket.set_nonblocking() == -1) {
+        throw(std::runtime_error("AsyncSocket"));
+    }
+}
+
+/// @brief Tries to send what is queued without blocking, and drops the rest.
+///  Buffers of write_ref() dropped are reported to their callback.
+AsyncSocket::~AsyncSocket() {
+    if (this->socket.get_sockfd() != -1) {
+        this->flush();
+        this->want_write(false);
+    }
+    while (!this->queue.empty()) {
+        this->release(this->queue.front(), false);
+        this->queue.pop_front();
+    }
+}
+
+/******************************************************************************
+ * Write functions
+******************************************************************************/
+
+/// @brief Sends as much of "msg" as possible without blocking, and copies the
+///  rest to the queue. "msg" can be reused as soon as it returns.
+/// @param msg Message to send.
+/// @param len Length of the message in bytes.
+/// @return "len" on success, or "-1" on error. "-1" with errno "ENOBUFS" if
+///  the queue can't hold "len" more bytes, so nothing was sent.
+int AsyncSocket::write(const void* msg, int len) {
+    return this->enqueue(msg, len, true, NULL, NULL);
+}
+
+/// @brief Like write(), but the part not sent is queued without copying it,
+///  so "msg" can't be modified or freed until "on_sent" is called.
+/// @param msg Message to send.
+/// @param len Length of the message in bytes.
+/// @param on_sent If not NULL, called with "msg" and "args" when the buffer is
+///  no longer used: "sent" is "true" after it was sent completely, and "false"
+///  if it was dropped because of an error or the destruction of this object.
+///  It's not called if this function fails.
+/// @param args Given to "on_sent".
+/// @return "len" on success, or "-1" on error, as in write().
+int AsyncSocket::write_ref(const void* msg, int len, SentCallback on_sent, void* args) {
+    return this->enqueue(msg, len, false, on_sent, args);
+}
+
+/// @brief Sends what is queued, until it's empty or the socket buffer is full.
+///  Must be called when the socket is writable; with set_poller(), when the
+///  poller reports "EPOLLOUT" for it.
+/// @return Amount of bytes still queued, or "-1" on error. After an error, the
+///  queue is dropped and every function fails with the same errno.
+int AsyncSocket::flush(void) {
+    struct msghdr msg;
+    int bytes_sent, total, count, aux;
+    std::deque<Chunk>::iterator p;
+    if (this->error != 0) {
+        errno = this->error;
+        return -1;
+    }
+    while (!this->queue.empty()) {
+        this->iov.clear();
+        total = 0;
+        for (p = this->queue.begin(), count = 0; p != this->queue.end() && count < IOV_MAX; p++, count++) {
+            struct iovec part = {(void*) (p->data + p->offset), (size_t) (p->len - p->offset)};
+            this->iov.push_back(part);
+            total += p->len - p->offset;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = this->iov.data();
+        msg.msg_iovlen = this->iov.size();
+        if ( (bytes_sent = this->socket.write_msg(&msg) ) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            this->error = errno;
+            while (!this->queue.empty()) {
+                this->release(this->queue.front(), false);
+                this->queue.pop_front();
+            }
+            this->pending = 0;
+            this->want_write(false);
+            errno = this->error;
+            return -1;
+        }
+        this->pending -= bytes_sent;
+        for (aux = bytes_sent; aux > 0; ) {
+            Chunk& chunk = this->queue.front();
+            count = std::min(aux, chunk.len - chunk.offset);
+            chunk.offset += count;
+            aux -= count;
+            if (chunk.offset == chunk.len) {
+                this->release(chunk, true);
+                this->queue.pop_front();
+            }
+        }
+        if (bytes_sent < total) {
+            // The socket buffer is full.
+            break;
+        }
+    }
+    this->want_write(!this->queue.empty());
+    if (this->high && this->pending <= this->low_watermark) {
+        this->high = false;
+        if (this->on_low != NULL) {
+            this->on_low(*this, this->watermark_args);
+        }
+    }
+    return this->pending;
+}
+
+/// @brief Sets the functions called when the queue reaches the high
+///  watermark, to stop producing data, and when it drains to the low one, to
+///  go on. Each one is called once per crossing.
+/// @param on_high Called with this object and "args" at the high watermark.
+/// @param on_low Called with this object and "args" at the low watermark.
+/// @param args Given to both functions (NULL by default).
+void AsyncSocket::set_watermark_callbacks(WatermarkCallback on_high, WatermarkCallback on_low, void* args) {
+    this->on_high = on_high;
+    this->on_low = on_low;
+    this->watermark_args = args;
+}
+
+/// @brief Makes the queue wait for "EPOLLOUT" in "poller" only while it has
+///  something to send, so a level triggered poller doesn't report the socket
+///  as writable over and over.
+/// @param poller Poller where the socket is registered, or NULL.
+/// @param events Events the socket is registered with, without "EPOLLOUT"
+///  ("EPOLLIN" by default).
+void AsyncSocket::set_poller(Poller* poller, uint32_t events) {
+    this->want_write(false);
+    this->poller = poller;
+    this->events = events;
+    this->writing = false;
+    this->want_write(!this->queue.empty());
+}
+
+/// @brief Returns the amount of bytes queued.
+int AsyncSocket::get_pending(void) const {
+    return this->pending;
+}
+
+/// @brief Returns "true" between the high watermark and the drain to the low
+///  one.
+bool AsyncSocket::is_high(void) const {
+    return this->high;
+}
+
+/// @brief Returns the socket.
+Socket& AsyncSocket::get_socket(void) {
+    return this->socket;
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Body of write() and write_ref(). The queue keeps the order, so
+///  nothing is sent directly while it has data.
+/// @param copy If "true", the part not sent is copied.
+/// @return "len" on success, or "-1" on error.
+int AsyncSocket::enqueue(const void* msg, int len, bool copy, SentCallback on_sent, void* args) {
+    int bytes_sent = 0;
+    Chunk chunk;
+    if (this->error != 0) {
+        errno = this->error;
+        return -1;
+    }
+    if (len < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (this->pending + len > this->max_pending) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (this->queue.empty() && len > 0) {
+        if ( (bytes_sent = this->socket.write((void*) msg, len) ) == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                this->error = errno;
+                return -1;
+            }
+            bytes_sent = 0;
+        }
+    }
+    if (bytes_sent == len) {
+        if (on_sent != NULL) {
+            on_sent(msg, true, args);
+        }
+        return len;
+    }
+    chunk.len = len - bytes_sent;
+    chunk.offset = 0;
+    chunk.owned = copy;
+    chunk.msg = msg;
+    chunk.on_sent = on_sent;
+    chunk.args = args;
+    if (copy) {
+        char* data = new char[chunk.len];
+        memcpy(data, (const char*) msg + bytes_sent, chunk.len);
+        chunk.data = data;
+    } else {
+        chunk.data = (const char*) msg + bytes_sent;
+    }
+    this->queue.push_back(chunk);
+    this->pending += chunk.len;
+    this->want_write(true);
+    if (!this->high && this->pending >= this->high_watermark) {
+        this->high = true;
+        if (this->on_high != NULL) {
+            this->on_high(*this, this->watermark_args);
+        }
+    }
+    return len;
+}
+
+/// @brief Frees a chunk that left the queue, and reports it to its callback.
+/// @param sent "true" if it was sent completely.
+void AsyncSocket::release(Chunk& chunk, bool sent) {
+    if (chunk.owned) {
+        delete[] chunk.data;
+    } else if (chunk.on_sent != NULL) {
+        chunk.on_sent(chunk.msg, sent, chunk.args);
+    }
+}
+
+/// @brief Adds or removes "EPOLLOUT" from the events of the socket in the
+///  poller, if any, when it changes.
+void AsyncSocket::want_write(bool enable) {
+    if (this->poller == NULL || this->writing == enable) {
+        return;
+    }
+    if (this->poller->modify(this->socket.get_sockfd(), this->events | (enable ? EPOLLOUT : 0)) == 0) {
+        this->writing = enable;
+    }
+}
@@ -0,0 +1,308 @@
+#include "poller.h"
+
+/******************************************************************************
+ * Constructors and destructor
+******************************************************************************/
+
+/// @brief Creates an empty poller.
+/// @return Might throw std::runtime_error on error.
+Poller::Poller() {
+    if ( (this->epfd = epoll_create1(EPOLL_CLOEXEC) ) == -1) {
+        perror(ERROR("epoll_create1 in Poller::Poller"));
+        throw(std::runtime_error("epoll_create1"));
+    }
+}
+
+/// @brief Closes the poller and the descriptors it created, from add_event(),
+///  add_timer() and add_signal(). Sockets and descriptors added by the user
+///  are left open.
+Poller::~Poller() {
+    std::map<int, Entry*>::iterator p;
+    for (p = this->entries.begin(); p != this->entries.end(); p++) {
+        if (p->second->type != FD && p->second->type != SOCKET) {
+            ::close(p->first);
+        }
+        delete p->second;
+    }
+    ::close(this->epfd);
+}
+
+/******************************************************************************
+ * Registration
+******************************************************************************/
+
+/// @brief Registers a socket.
+/// @param socket Socket to wait on. It must stay open while registered.
+/// @param events Events to wait for: "EPOLLIN", "EPOLLOUT", "EPOLLRDHUP",
+///  "EPOLLONESHOT"... ("EPOLLIN" by default). "EPOLLERR" and "EPOLLHUP" are
+///  always reported.
+/// @param edge If "true", edge triggered: an event is reported once each time
+///  the socket changes, so it must be read or written until "EAGAIN", in
+///  non-blocking mode. If "false", level triggered: it's reported on every
+///  wait() while the socket is ready ("false" by default).
+/// @param data Given back with the events of the socket. If NULL, "&socket".
+/// @return "0" on success, "-1" on error, with errno "EEXIST" if the socket
+///  was already registered.
+int Poller::add(Socket& socket, uint32_t events, bool edge, void* data) {
+    return this->add_entry(socket.get_sockfd(), SOCKET, events, edge, (data == NULL) ? &socket : data);
+}
+
+/// @brief Registers any file descriptor that works with epoll: pipes,
+///  eventfds, message queues of POSIX... Same parameters as
+///  add(Socket& socket, ...), with the user data given as is.
+/// @return "0" on success, "-1" on error.
+int Poller::add(int fd, uint32_t events, bool edge, void* data) {
+    return this->add_entry(fd, FD, events, edge, data);
+}
+
+/// @brief Changes the events a registered descriptor waits for. Used to wait
+///  for "EPOLLOUT" only while there is something to write, or to rearm an
+///  "EPOLLONESHOT" descriptor.
+/// @param fd Registered descriptor.
+/// @param events New events to wait for.
+/// @param edge "true" for edge triggered ("false" by default).
+/// @return "0" on success, "-1" on error, with errno "ENOENT" if "fd" is not
+///  registered.
+int Poller::modify(int fd, uint32_t events, bool edge) {
+    std::map<int, Entry*>::iterator p;
+    struct epoll_event ev;
+    if ( (p = this->entries.find(fd) ) == this->entries.end()) {
+        errno = ENOENT;
+        return -1;
+    }
+    ev.events = events | (edge ? EPOLLET : 0);
+    ev.data.ptr = p->second;
+    if (epoll_ctl(this->epfd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+        perror(ERROR("epoll_ctl in Poller::modify"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Stops waiting on a descriptor. Descriptors created by the poller are
+///  closed; sockets and descriptors added by the user are not. It must be
+///  called before closing a registered socket.
+/// @param fd Registered descriptor.
+/// @return "0" on success, "-1" on error, with errno "ENOENT" if "fd" is not
+///  registered.
+int Poller::remove(int fd) {
+    std::map<int, Entry*>::iterator p;
+    int status = 0;
+    if ( (p = this->entries.find(fd) ) == this->entries.end()) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (epoll_ctl(this->epfd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        perror(ERROR("epoll_ctl in Poller::remove"));
+        status = -1;
+    }
+    if (p->second->type != FD && p->second->type != SOCKET) {
+        ::close(fd);
+    }
+    delete p->second;
+    this->entries.erase(p);
+    return status;
+}
+
+/// @brief Creates and registers an eventfd, which other threads or processes
+///  can use to wake up the poller with notify(). Its counter must be cleared
+///  with consume() when it's reported.
+/// @param data Given back with its events (NULL by default).
+/// @return The eventfd, or "-1" on error.
+int Poller::add_event(void* data) {
+    int fd;
+    if ( (fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ) == -1) {
+        perror(ERROR("eventfd in Poller::add_event"));
+        return -1;
+    }
+    if (this->add_entry(fd, EVENT, EPOLLIN, false, data) == -1) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// @brief Creates and registers a timer. Its expirations must be cleared with
+///  consume() when it's reported.
+/// @param interval_ms Milliseconds until it expires.
+/// @param periodic If "true", it expires again every "interval_ms"
+///  milliseconds ("true" by default).
+/// @param data Given back with its events (NULL by default).
+/// @return The timerfd, or "-1" on error.
+int Poller::add_timer(int interval_ms, bool periodic, void* data) {
+    struct itimerspec spec;
+    int fd;
+    if (interval_ms <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = interval_ms / 1000;
+    spec.it_value.tv_nsec = (interval_ms % 1000) * 1000000L;
+    if (periodic) {
+        spec.it_interval = spec.it_value;
+    }
+    if ( (fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) ) == -1) {
+        perror(ERROR("timerfd_create in Poller::add_timer"));
+        return -1;
+    }
+    if (timerfd_settime(fd, 0, &spec, NULL) == -1) {
+        perror(ERROR("timerfd_settime in Poller::add_timer"));
+        ::close(fd);
+        return -1;
+    }
+    if (this->add_entry(fd, TIMER, EPOLLIN, false, data) == -1) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// @brief Creates and registers a signalfd, so a signal is attended as one
+///  more event instead of interrupting the thread. The signal is blocked in the
+///  calling thread, and stays blocked after it's removed. Each signal
+///  received must be read with read_signal().
+/// @param signal Signal number.
+/// @param data Given back with its events (NULL by default).
+/// @return The signalfd, or "-1" on error.
+int Poller::add_signal(int signal, void* data) {
+    sigset_t mask;
+    int fd;
+    sigemptyset(&mask);
+    if (sigaddset(&mask, signal) == -1) {
+        perror(ERROR("sigaddset in Poller::add_signal"));
+        return -1;
+    }
+    if (Signal::block(signal) == -1) {
+        return -1;
+    }
+    if ( (fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC) ) == -1) {
+        perror(ERROR("signalfd in Poller::add_signal"));
+        return -1;
+    }
+    if (this->add_entry(fd, SIGNAL, EPOLLIN, false, data) == -1) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/******************************************************************************
+ * Waiting
+******************************************************************************/
+
+/// @brief Waits until any registered descriptor is ready, and returns a batch
+///  of them with a single system call.
+/// @param events Where the ready descriptors will be stored.
+/// @param max_events Size of "events". Descriptors left out are returned by
+///  the next call.
+/// @param timeout Maximum milliseconds to wait. "-1" waits forever, and "0"
+///  returns right away ("-1" by default).
+/// @return Amount of events stored, "0" if the timeout expired, or "-1" on
+///  error. "-1" with errno "EINTR" if a signal interrupted the wait.
+int Poller::wait(Event* events, int max_events, int timeout) {
+    Entry* entry;
+    int i, ready;
+    if (max_events <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (this->ready.size() < (size_t) max_events) {
+        this->ready.resize(max_events);
+    }
+    if ( (ready = epoll_wait(this->epfd, this->ready.data(), max_events, timeout) ) == -1) {
+        if (errno != EINTR) {
+            perror(ERROR("epoll_wait in Poller::wait"));
+        }
+        return -1;
+    }
+    for (i = 0; i < ready; i++) {
+        entry = (Entry*) this->ready[i].data.ptr;
+        events[i].fd = entry->fd;
+        events[i].events = this->ready[i].events;
+        events[i].type = entry->type;
+        events[i].data = entry->data;
+    }
+    return ready;
+}
+
+/// @brief Wakes up a poller waiting on an eventfd made with add_event(). Safe
+///  to call from any thread, or from a signal handler.
+/// @param fd The eventfd.
+/// @param value Added to its counter ("1" by default).
+/// @return "0" on success, "-1" on error, with "errno" set. It prints
+///  nothing: perror() isn't async-signal-safe.
+int Poller::notify(int fd, uint64_t value) {
+    if (::write(fd, &value, sizeof(value)) != sizeof(value)) {
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Clears an eventfd or a timerfd after it's reported.
+/// @param fd The eventfd or the timerfd.
+/// @param value If not NULL, where the counter of the eventfd, or the amount
+///  of expirations of the timer, will be stored.
+/// @return "0" on success, "-1" on error. "-1" with errno "EAGAIN" if it was
+///  already cleared.
+int Poller::consume(int fd, uint64_t* value) {
+    uint64_t aux;
+    if (::read(fd, &aux, sizeof(aux)) != sizeof(aux)) {
+        if (errno != EAGAIN) {
+            perror(ERROR("read in Poller::consume"));
+        }
+        return -1;
+    }
+    if (value != NULL) {
+        *value = aux;
+    }
+    return 0;
+}
+
+/// @brief Reads a signal from a signalfd made with add_signal().
+/// @param fd The signalfd.
+/// @return The signal number, or "-1" on error. "-1" with errno "EAGAIN" if
+///  there are no more signals pending.
+int Poller::read_signal(int fd) {
+    struct signalfd_siginfo info;
+    if (::read(fd, &info, sizeof(info)) != sizeof(info)) {
+        if (errno != EAGAIN) {
+            perror(ERROR("read in Poller::read_signal"));
+        }
+        return -1;
+    }
+    return (int) info.ssi_signo;
+}
+
+/// @brief Returns the amount of registered descriptors.
+int Poller::get_size(void) const {
+    return (int) this->entries.size();
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Registers a descriptor in epoll, and keeps its user data.
+/// @return "0" on success, "-1" on error.
+int Poller::add_entry(int fd, Type type, uint32_t events, bool edge, void* data) {
+    struct epoll_event ev;
+    Entry* entry;
+    if (this->entries.count(fd) > 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    entry = new Entry;
+    entry->fd = fd;
+    entry->type = type;
+    entry->data = data;
+    ev.events = events | (edge ? EPOLLET : 0);
+    ev.data.ptr = entry;
+    if (epoll_ctl(this->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror(ERROR("epoll_ctl in Poller::add"));
+        delete entry;
+        return -1;
+    }
+    this->entries[fd] = entry;
+    return 0;
+}
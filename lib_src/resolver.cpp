@@ -0,0 +1,191 @@
+#include "resolver.h"
+
+std::map<std::string, Resolver::Entry> Resolver::cache;
+Mutex Resolver::mutex;
+int Resolver::ttl = 30000;
+int Resolver::negative_ttl = 5000;
+
+/******************************************************************************
+ * Resolution
+******************************************************************************/
+
+/// @brief Gets the addresses of a host, from the cache if they were looked up
+///  less than "ttl" milliseconds ago, or with "getaddrinfo()" otherwise.
+/// @param host IP address or host name. If NULL, addresses to listen on any
+///  IP of the device ("AI_PASSIVE").
+/// @param port Port number as a string, or any protocol defined in
+///  "/etc/services". If NULL, the port of the addresses is "0".
+/// @param family AF_INET, AF_INET6 or AF_UNSPEC.
+/// @param socktype SOCK_STREAM or SOCK_DGRAM.
+/// @param addrs Where the addresses will be stored, in the order given by
+///  "getaddrinfo()".
+/// @return "0" on success, or the error code of "getaddrinfo()", which can be
+///  printed with "gai_strerror()".
+int Resolver::resolve(const char* host, const char* port, int family, int socktype, std::vector<Address>& addrs) {
+    std::string key = Resolver::get_key(host, port, family, socktype);
+    struct addrinfo hints;
+    struct addrinfo* res, *p;
+    Address addr;
+    Entry entry;
+
+    if (Resolver::lookup(key, addrs, entry.status)) {
+        return entry.status;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = socktype;
+    hints.ai_protocol = 0;
+    hints.ai_flags = (host == NULL) ? AI_PASSIVE : 0;
+    if ( (entry.status = getaddrinfo(host, port, &hints, &res) ) == 0) {
+        for (p = res; p != NULL; p = p->ai_next) {
+            addr.family = p->ai_family;
+            addr.socktype = p->ai_socktype;
+            addr.protocol = p->ai_protocol;
+            memcpy(&addr.addr, p->ai_addr, p->ai_addrlen);
+            addr.addrlen = p->ai_addrlen;
+            entry.addrs.push_back(addr);
+        }
+        freeaddrinfo(res);
+    }
+    addrs = entry.addrs;
+    if (entry.status == EAI_SYSTEM || entry.status == EAI_MEMORY) {
+        // Local problems, not an answer about the host.
+        return entry.status;
+    }
+    entry.expires = Resolver::now() + ((entry.status == 0) ? Resolver::ttl : Resolver::negative_ttl);
+    Resolver::mutex.lock();
+    Resolver::evict();
+    Resolver::cache[key] = entry;
+    Resolver::mutex.unlock();
+    return entry.status;
+}
+
+/// @brief Resolves a host on a helper thread, so the caller never blocks on
+///  the resolver. If the addresses are already cached, "on_resolved" is
+///  called right away in the calling thread.
+/// @param on_resolved If not NULL, called with the same results as
+///  Resolver::resolve(). If NULL, the lookup only fills the cache, so a later
+///  Socket to that host doesn't wait for it.
+/// @param args Passed to "on_resolved".
+/// @return "0" if the lookup was started or answered from the cache, "-1" if
+///  the thread couldn't be created.
+int Resolver::resolve_async(const char* host, const char* port, int family, int socktype,
+    Callback on_resolved, void* args) {
+    std::vector<Address> addrs;
+    Request* request;
+    int status;
+    // Taken at once: an entry that expired after a separate check would block.
+    if (Resolver::lookup(Resolver::get_key(host, port, family, socktype), addrs, status)) {
+        if (on_resolved != NULL) {
+            on_resolved(status, addrs, args);
+        }
+        return 0;
+    }
+    request = new Request;
+    request->null_host = (host == NULL);
+    request->host = (host == NULL) ? "" : host;
+    request->null_port = (port == NULL);
+    request->port = (port == NULL) ? "" : port;
+    request->family = family;
+    request->socktype = socktype;
+    request->on_resolved = on_resolved;
+    request->args = args;
+    try {
+        Thread thread(Resolver::run_request, request, true);
+    } catch (std::runtime_error&) {
+        delete request;
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Returns "true" if the addresses of the host are in the cache, and
+///  haven't expired.
+bool Resolver::is_cached(const char* host, const char* port, int family, int socktype) {
+    std::map<std::string, Entry>::iterator it;
+    bool cached;
+    Resolver::mutex.lock();
+    it = Resolver::cache.find(Resolver::get_key(host, port, family, socktype));
+    cached = (it != Resolver::cache.end() && it->second.expires > Resolver::now());
+    Resolver::mutex.unlock();
+    return cached;
+}
+
+/// @brief Sets how long lookups are kept in the cache. Only affects the ones
+///  made afterwards.
+/// @param ttl Milliseconds for successful lookups ("30000" by default).
+/// @param negative_ttl Milliseconds for failed lookups ("5000" by default).
+void Resolver::set_ttl(int ttl, int negative_ttl) {
+    Resolver::mutex.lock();
+    Resolver::ttl = ttl;
+    Resolver::negative_ttl = negative_ttl;
+    Resolver::mutex.unlock();
+}
+
+/// @brief Removes every lookup from the cache.
+void Resolver::clear(void) {
+    Resolver::mutex.lock();
+    Resolver::cache.clear();
+    Resolver::mutex.unlock();
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+std::string Resolver::get_key(const char* host, const char* port, int family, int socktype) {
+    char numbers[32];
+    snprintf(numbers, sizeof(numbers), "|%d|%d|", family, socktype);
+    // A NULL host or port is not the same as an empty one.
+    return std::string((host == NULL) ? "\n" : host) + numbers + ((port == NULL) ? "\n" : port);
+}
+
+/// @brief Copies the addresses of "key" from the cache, if they haven't
+///  expired.
+/// @param status Result of the lookup, when found.
+/// @return "true" if found.
+bool Resolver::lookup(const std::string& key, std::vector<Address>& addrs, int& status) {
+    std::map<std::string, Entry>::iterator it;
+    bool found;
+    Resolver::mutex.lock();
+    it = Resolver::cache.find(key);
+    if ( (found = (it != Resolver::cache.end() && it->second.expires > Resolver::now()) ) ) {
+        addrs = it->second.addrs;
+        status = it->second.status;
+    }
+    Resolver::mutex.unlock();
+    return found;
+}
+
+/// @brief Removes the expired lookups from the cache. The mutex must be held.
+void Resolver::evict(void) {
+    long long now = Resolver::now();
+    std::map<std::string, Entry>::iterator it = Resolver::cache.begin();
+    while (it != Resolver::cache.end()) {
+        if (it->second.expires <= now) {
+            Resolver::cache.erase(it++);
+        } else {
+            it++;
+        }
+    }
+}
+
+/// @brief Returns CLOCK_MONOTONIC in milliseconds.
+long long Resolver::now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/// @brief Helper thread of Resolver::resolve_async().
+void* Resolver::run_request(void* request) {
+    Request* req = (Request*) request;
+    std::vector<Address> addrs;
+    int status = Resolver::resolve(req->null_host ? NULL : req->host.c_str(),
+        req->null_port ? NULL : req->port.c_str(), req->family, req->socktype, addrs);
+    if (req->on_resolved != NULL) {
+        req->on_resolved(status, addrs, req->args);
+    }
+    delete req;
+    return NULL;
+}
@@ -1,19 +1,45 @@
 #include "server.h"
 
-bool Server::exit;
+std::atomic<Server::Instance*> Server::instances(NULL);
+std::atomic<int> Server::leaving(0);
+thread_local Server::Reactor* Server::current_reactor = NULL;
+thread_local Server::UringLoop* Server::current_uring = NULL;
+thread_local Server::Datagrams* Server::current_datagrams = NULL;
 
 /// @brief Creates a server. Uses same parameters as Socket::Socket().
+/// @param reuse_port Must be "true" to use Server::start_prefork() or
+///  Server::start_threaded().
+/// @param profile Set on the listening socket and on every client accepted,
+///  see Socket::set_profile() ("SOCKET_PROFILE_DEFAULT" by default).
 /// @return Might throw std::runtime_error on error.
-Server::Server(const char* ip, const char* port, int family, int socktype):
-    socket(ip, port, family, socktype, true) {
-    Server::exit = false;
+Server::Server(const char* ip, const char* port, int family, int socktype, bool reuse_port,
+        SocketProfile profile):
+    socket(ip, port, family, socktype, true, reuse_port, profile), recv_size(0), exit(false) {
+    if ( (this->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ) == -1) {
+        perror(ERROR("eventfd in Server::Server"));
+        throw(std::runtime_error("eventfd"));
+    }
     Signal::ignore(SIGCHLD);  // Ignoring childs is necessary to avoid zombies.
+    // Registered servers are stopped by Server::leave() on SIGINT.
+    this->register_instance();
     Signal::set_handler(SIGINT, &Server::leave);
 }
 
+/// @brief Unregisters the server and frees its resources.
+Server::~Server() {
+    this->instance->server.store(NULL);
+    // A handler that took this server before it was unregistered must be done
+    // with it before it's freed.
+    while (Server::leaving.load() > 0) {
+        sched_yield();
+    }
+    ::close(this->stop_fd);
+}
+
 /// @brief Starts the server, blocks operation. Every time a new connection is
 ///  received, the function "on_accept()" will be called. The server will keep
-///  running until "on_quit()" return true.
+///  running until "on_quit()" return true. Servers created with "SOCK_DGRAM"
+///  run start_datagram() instead.
 /// @param backlog Number of clients that can be put "on hold".
 void Server::start(int backlog) {
     int client_sockfd;
@@ -21,14 +47,23 @@ void Server::start(int backlog) {
     struct sockaddr_storage client_addr;
     socklen_t addrlen = sizeof(struct sockaddr_storage);
     int buff;
+    socklen_t optlen = sizeof(int);
 
+    if (getsockopt(this->socket.get_sockfd(), SOL_SOCKET, SO_TYPE, &buff, &optlen) == 0 && buff == SOCK_DGRAM) {
+        this->start_datagram();
+        return;
+    }
     this->backlog = backlog;
-    while(!Server::exit) {
+    if (listen(this->socket.get_sockfd(), this->backlog) != 0) {
+        perror(ERROR("Couldn't start the server with listen"));
+        return;
+    }
+    while(!this->exit) {
         this->on_start();
-        if (listen(this->socket.get_sockfd(), this->backlog) != 0) {
-            perror(ERROR("Couldn't start the server with listen"));
-            return;
+        if (this->wait_client(this->socket) == -1) {
+            continue;
         }
+        addrlen = sizeof(struct sockaddr_storage);
         if ( (client_sockfd = accept(this->socket.get_sockfd(), (struct sockaddr*) &client_addr, &addrlen) ) == -1) {
             if (errno != EINTR) {
                 // The accept was NOT terminated by a signal
@@ -36,7 +71,7 @@ void Server::start(int backlog) {
             }
             continue;
         }
-        if (client_socket.init(client_sockfd, (struct sockaddr*) &client_addr) == -1) {
+        if (this->init_client(client_socket, client_sockfd, (struct sockaddr*) &client_addr, addrlen) == -1) {
             client_socket.close();
             continue;
         }
@@ -55,12 +90,986 @@ void Server::start(int backlog) {
     this->on_quit();
 }
 
+/// @brief Starts the server in event loop mode, blocks operation. Instead of
+///  forking a child for every connection, clients are multiplexed with epoll
+///  and the functions "on_readable()", "on_writable()" and "on_close()" are
+///  called for each of them. Client sockets are non-blocking. The server keeps
+///  running until it is stopped.
+/// @param backlog Number of clients that can be put "on hold".
+/// @param reactors Number of threads with their own epoll instance, counting
+///  the calling one. All of them accept connections from the same listening
+///  socket, and a client is always attended by the reactor that accepted it.
+/// @param max_events Maximum number of events (and new connections) handled
+///  per "epoll_wait()" call.
+void Server::start_event_loop(int backlog, int reactors, int max_events) {
+    struct epoll_event ev;
+    sigset_t old_mask;
+    int created = 0;
+
+    if (reactors < 1) {
+        reactors = 1;
+    }
+    std::vector<Reactor> reactor_list(reactors);
+    std::vector<Thread> threads(reactors);
+    this->backlog = backlog;
+    this->on_start();
+    if (listen(this->socket.get_sockfd(), this->backlog) != 0) {
+        perror(ERROR("Couldn't start the server with listen"));
+        return;
+    }
+    if (this->socket.set_nonblocking() == -1) {
+        return;
+    }
+    for (created = 0; created < reactors; created++) {
+        reactor_list[created].server = this;
+        reactor_list[created].max_events = max_events;
+        if ( (reactor_list[created].epfd = epoll_create1(EPOLL_CLOEXEC) ) == -1) {
+            perror(ERROR("epoll_create1 in Server::start_event_loop"));
+            break;
+        }
+        // Only one of the reactors is woken up for each new connection.
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &this->socket;
+        if (epoll_ctl(reactor_list[created].epfd, EPOLL_CTL_ADD, this->socket.get_sockfd(), &ev) == -1) {
+            perror(ERROR("epoll_ctl in Server::start_event_loop"));
+            ::close(reactor_list[created].epfd);
+            break;
+        }
+        ev.events = EPOLLIN;
+        ev.data.ptr = &this->stop_fd;
+        if (epoll_ctl(reactor_list[created].epfd, EPOLL_CTL_ADD, this->stop_fd, &ev) == -1) {
+            perror(ERROR("epoll_ctl in Server::start_event_loop"));
+            ::close(reactor_list[created].epfd);
+            break;
+        }
+    }
+    if (created == reactors) {
+        // SIGINT must interrupt the calling thread, not the helper reactors,
+        // which inherit the mask.
+        Signal::block(SIGINT, &old_mask);
+        for (int i = 1; i < reactors; i++) {
+            threads[i].create(&Server::run_reactor, &reactor_list[i]);
+        }
+        Signal::restore_mask(&old_mask);
+        this->reactor_loop(&reactor_list[0]);
+        for (int i = 1; i < reactors; i++) {
+            threads[i].join();
+        }
+    }
+    for (int i = 0; i < created; i++) {
+        ::close(reactor_list[i].epfd);
+    }
+    this->socket.close();
+    this->on_quit();
+}
+
+/// @brief Starts the server with a pool of "workers" processes, forked once,
+///  blocks operation. Each worker binds its own listening socket to the same
+///  address with "SO_REUSEPORT", so the kernel balances the connections
+///  between them, and attends its clients one at a time with "on_accept()".
+///  After a SIGINT, every worker finishes its current client and exits, and
+///  the server waits for all of them before returning.
+/// @param workers Number of worker processes.
+/// @param backlog Number of clients that can be put "on hold", per worker.
+/// @param pin_cpu If "true", worker "i" only runs on CPU "i" (modulo the
+///  amount of CPUs online).
+void Server::start_prefork(int workers, int backlog, bool pin_cpu) {
+    std::vector<pid_t> pids;
+    struct signalfd_siginfo info;
+    struct pollfd pfd[2];
+    sigset_t wait_mask, old_mask;
+    pid_t pid;
+
+    if (!this->has_reuse_port()) {
+        fprintf(stderr, ERROR("Server::start_prefork needs a server created with \"reuse_port\"\n"));
+        return;
+    }
+    this->backlog = backlog;
+    this->on_start();
+    // Workers are reaped by the server, so SIGCHLD can't be ignored. SIGINT
+    // stays blocked in the workers, except while they wait for a client.
+    Signal::set_default_handler(SIGCHLD);
+    Signal::block(SIGCHLD, &old_mask);
+    Signal::block(SIGINT);
+    for (int i = 0; i < workers; i++) {
+        if ( (pid = fork()) == -1) {
+            perror(ERROR("fork in Server::start_prefork. Failed to create worker"));
+            break;
+        } else if (pid == 0) {
+            Signal::unblock(SIGCHLD);
+            // The eventfd must not be shared with the parent.
+            ::close(this->stop_fd);
+            if ( (this->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ) == -1) {
+                perror(ERROR("eventfd in Server::start_prefork"));
+                ::exit(1);
+            }
+            this->run_worker(i, pin_cpu);
+            ::exit(0);
+        }
+        pids.push_back(pid);
+    }
+    sigemptyset(&wait_mask);
+    sigaddset(&wait_mask, SIGINT);
+    sigaddset(&wait_mask, SIGCHLD);
+    if ( (pfd[0].fd = signalfd(-1, &wait_mask, SFD_CLOEXEC) ) == -1) {
+        perror(ERROR("signalfd in Server::start_prefork"));
+    }
+    pfd[0].events = POLLIN;
+    pfd[1].fd = this->stop_fd;
+    pfd[1].events = POLLIN;
+    while (pfd[0].fd != -1 && !pids.empty() && !this->exit) {
+        if (poll(pfd, 2, -1) == -1) {
+            if (errno != EINTR) {
+                perror(ERROR("poll in Server::start_prefork"));
+                break;
+            }
+            continue;
+        }
+        if (pfd[1].revents || read(pfd[0].fd, &info, sizeof(info)) != sizeof(info) ||
+                info.ssi_signo == SIGINT) {
+            break;
+        }
+        // A worker died on its own.
+        for (size_t i = 0; i < pids.size(); i++) {
+            if (waitpid(pids[i], NULL, WNOHANG) == pids[i]) {
+                pids.erase(pids.begin() + i--);
+            }
+        }
+    }
+    this->exit = true;
+    for (size_t i = 0; i < pids.size(); i++) {
+        Signal::kill(pids[i], SIGINT);
+    }
+    for (size_t i = 0; i < pids.size(); i++) {
+        while (waitpid(pids[i], NULL, 0) == -1 && errno == EINTR);
+    }
+    if (pfd[0].fd != -1) {
+        ::close(pfd[0].fd);
+    }
+    Signal::restore_mask(&old_mask);
+    Signal::ignore(SIGCHLD);
+    this->socket.close();
+    this->on_quit();
+}
+
+/// @brief Starts the server with a pool of "threads", blocks operation. Each
+///  thread binds its own listening socket to the same address with
+///  "SO_REUSEPORT", so the kernel balances the connections between them, and
+///  attends its clients one at a time with "on_accept()". After stop() or a
+///  SIGINT, every thread finishes its current client, and the server waits for
+///  all of them before returning.
+/// @param threads Number of threads. If "0", one per CPU online.
+/// @param backlog Number of clients that can be put "on hold", per thread.
+/// @param pin_cpu If "true", thread "i" only runs on CPU "i" (modulo the
+///  amount of CPUs online).
+void Server::start_threaded(int threads, int backlog, bool pin_cpu) {
+    struct pollfd pfd;
+    sigset_t old_mask;
+
+    if (!this->has_reuse_port()) {
+        fprintf(stderr, ERROR("Server::start_threaded needs a server created with \"reuse_port\"\n"));
+        return;
+    }
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    std::vector<Thread> thread_list(threads);
+    std::vector<Worker> workers(threads);
+    this->backlog = backlog;
+    this->on_start();
+    // SIGINT stays blocked in the threads, except while they wait for a client.
+    Signal::block(SIGINT, &old_mask);
+    for (int i = 0; i < threads; i++) {
+        workers[i].server = this;
+        workers[i].index = i;
+        workers[i].pin_cpu = pin_cpu;
+        thread_list[i].create(&Server::run_thread, &workers[i]);
+    }
+    Signal::restore_mask(&old_mask);
+    pfd.fd = this->stop_fd;
+    pfd.events = POLLIN;
+    while (!this->exit && poll(&pfd, 1, -1) <= 0);
+    for (int i = 0; i < threads; i++) {
+        thread_list[i].join();
+    }
+    this->socket.close();
+    this->on_quit();
+}
+
+/// @brief Enables TCP Fast Open on the server, so clients using
+///  Socket::connect_fastopen() can send their first message in the SYN. Must be
+///  called before starting the server. The workers of start_prefork() and
+///  start_threaded() get the same queue length.
+/// @param qlen See Socket::set_fastopen() ("16" by default).
+/// @return "0" on success, "-1" on error. The server works anyway, with a
+///  regular handshake.
+int Server::set_fastopen(int qlen) {
+    return this->socket.set_fastopen(qlen);
+}
+
+/// @brief Stops the server. Every mode of the server finishes attending its
+///  current clients and returns. Can be called from any thread, and from
+///  signal handlers.
+void Server::stop(void) {
+    uint64_t wake = 1;
+    ssize_t written;
+    this->exit = true;
+    // The eventfd is never read, so it stays readable for every waiter. A
+    // failure can't be reported here: perror() isn't async-signal-safe.
+    written = ::write(this->stop_fd, &wake, sizeof(wake));
+    (void) written;
+}
+
 /// @brief Returns the socket
 Socket& Server::get_socket(void) {
     return this->socket;
 }
 
-/// @brief Handler for SIGINT signal. Makes the server end.
+/// @brief Handler for SIGINT signal. Makes every server in the process end.
+///  It only uses lock-free atomics and stop(), so it's safe in any thread, even
+///  while other threads create or destroy servers.
 void Server::leave(int) {
-    Server::exit = true;
+    int saved_errno = errno;
+    Server* server;
+    Server::leaving.fetch_add(1);
+    for (Instance* node = Server::instances.load(); node != NULL; node = node->next) {
+        if ( (server = node->server.load() ) != NULL) {
+            server->stop();
+        }
+    }
+    Server::leaving.fetch_sub(1);
+    errno = saved_errno;
+}
+
+/******************************************************************************
+ * Event loop
+******************************************************************************/
+
+/// @brief Event loop mode only. Enables or disables "on_writable()" calls for
+///  a client. Must be called from one of the event loop functions.
+/// @param socket Client socket, as received in "on_readable()".
+/// @param enable "true" to be notified when the client can be written.
+/// @return "0" on success, "-1" on error.
+int Server::want_write(Socket& socket, bool enable) {
+    struct epoll_event ev;
+    if (Server::current_reactor == NULL) {
+        fprintf(stderr, ERROR("Server::want_write called outside of the event loop\n"));
+        return -1;
+    }
+    ev.events = EPOLLIN | EPOLLRDHUP | ((enable) ? EPOLLOUT : 0);
+    ev.data.ptr = &socket;
+    if (epoll_ctl(Server::current_reactor->epfd, EPOLL_CTL_MOD, socket.get_sockfd(), &ev) == -1) {
+        perror(ERROR("epoll_ctl in Server::want_write"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Event loop and io_uring modes. Calls "on_close()" and releases the
+///  client. The socket must not be used after this call.
+/// @param socket Client socket, as received in "on_readable()" or "on_recv()".
+void Server::close_client(Socket& socket) {
+    Reactor* reactor = Server::current_reactor;
+    if (Server::current_uring != NULL) {
+        std::map<Socket*, int>::iterator it = Server::current_uring->slots.find(&socket);
+        if (it != Server::current_uring->slots.end()) {
+            this->uring_release(Server::current_uring, it->second);
+        }
+        return;
+    }
+    if (reactor == NULL || reactor->clients.erase(&socket) == 0) {
+        return;
+    }
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, socket.get_sockfd(), NULL);
+    this->on_close(socket);
+    // Events of the same batch may still point to it.
+    socket.close();
+    reactor->closed.push_back(&socket);
+}
+
+/// @brief Thread function for the helper reactors.
+/// @param reactor Pointer to the Reactor to run.
+void* Server::run_reactor(void* reactor) {
+    ((Reactor*) reactor)->server->reactor_loop((Reactor*) reactor);
+    return NULL;
+}
+
+/// @brief Waits for events on the reactor and dispatches them, until the
+///  server is stopped. Closes the remaining clients before returning.
+void Server::reactor_loop(Reactor* reactor) {
+    std::vector<struct epoll_event> events(reactor->max_events);
+    std::vector<char> buffer(this->recv_size);
+    bool running = true;
+    int ready;
+
+    Server::current_reactor = reactor;
+    while (running && !this->exit) {
+        if ( (ready = epoll_wait(reactor->epfd, events.data(), reactor->max_events, -1) ) == -1) {
+            if (errno != EINTR) {
+                perror(ERROR("epoll_wait in Server::reactor_loop"));
+                break;
+            }
+            continue;
+        }
+        for (int i = 0; i < ready; i++) {
+            void* ptr = events[i].data.ptr;
+            uint32_t flags = events[i].events;
+            if (ptr == &this->stop_fd) {
+                running = false;
+            } else if (ptr == &this->socket) {
+                this->accept_clients(reactor);
+            } else if (reactor->clients.count((Socket*) ptr)) {
+                Socket* client = (Socket*) ptr;
+                char peek;
+                if ((flags & EPOLLIN) && this->recv_size > 0) {
+                    // io_uring fallback, see Server::start_uring().
+                    int bytes_read = client->read(buffer.data(), this->recv_size);
+                    if (bytes_read > 0) {
+                        this->on_recv(*client, buffer.data(), bytes_read);
+                    } else if (bytes_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        this->close_client(*client);
+                        continue;
+                    }
+                } else if (flags & EPOLLIN) {
+                    this->on_readable(*client);
+                }
+                if ((flags & EPOLLOUT) && reactor->clients.count(client)) {
+                    this->on_writable(*client);
+                }
+                if (!reactor->clients.count(client)) {
+                    continue;
+                }
+                // The peer closed and there is nothing left to read.
+                if ((flags & (EPOLLERR | EPOLLHUP)) || ((flags & EPOLLRDHUP) &&
+                        recv(client->get_sockfd(), &peek, 1, MSG_PEEK | MSG_DONTWAIT) <= 0)) {
+                    this->close_client(*client);
+                }
+            }
+        }
+        Server::free_closed(reactor);
+    }
+    // Wake up the rest of the reactors.
+    this->stop();
+    while (!reactor->clients.empty()) {
+        this->close_client(**reactor->clients.begin());
+    }
+    Server::free_closed(reactor);
+    Server::current_reactor = NULL;
+}
+
+/// @brief Frees the clients closed while attending a batch of events, once no
+///  event of the batch can point to them.
+void Server::free_closed(Reactor* reactor) {
+    for (size_t i = 0; i < reactor->closed.size(); i++) {
+        delete reactor->closed[i];
+    }
+    reactor->closed.clear();
+}
+
+/// @brief Accepts all pending connections (up to "max_events") and adds them
+///  to the reactor.
+void Server::accept_clients(Reactor* reactor) {
+    struct sockaddr_storage client_addr;
+    socklen_t addrlen;
+    struct epoll_event ev;
+    int client_sockfd;
+    Socket* client;
+
+    for (int i = 0; i < reactor->max_events; i++) {
+        addrlen = sizeof(struct sockaddr_storage);
+        if ( (client_sockfd = accept4(this->socket.get_sockfd(), (struct sockaddr*) &client_addr,
+                &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC) ) == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror(WARNING("Couldn't accept a connection from a client"));
+            }
+            return;
+        }
+        client = new Socket();
+        if (this->init_client(*client, client_sockfd, (struct sockaddr*) &client_addr, addrlen) == -1) {
+            delete client;
+            continue;
+        }
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = client;
+        if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, client_sockfd, &ev) == -1) {
+            perror(ERROR("epoll_ctl in Server::accept_clients"));
+            delete client;
+            continue;
+        }
+        reactor->clients.insert(client);
+        this->on_new_client();
+    }
+}
+
+/******************************************************************************
+ * Worker pool
+******************************************************************************/
+
+/// @brief Initializes a socket returned by "accept()", with the profile of the
+///  server. Same parameters as Socket::init().
+/// @return "0" on success, "-1" on error.
+int Server::init_client(Socket& client, int sockfd, struct sockaddr* addr, socklen_t addrlen) {
+    if (client.init(sockfd, addr, addrlen) == -1) {
+        return -1;
+    }
+    // The options are inherited from the listening socket, but the client has
+    // to know its profile to keep "TCP_QUICKACK".
+    client.inherit_profile(this->socket);
+    return 0;
+}
+
+/// @brief Adds the server to the list walked by leave(), in an entry left
+///  empty by a destroyed server, or in a new one.
+void Server::register_instance(void) {
+    Server* expected;
+    for (Instance* node = Server::instances.load(); node != NULL; node = node->next) {
+        expected = NULL;
+        if (node->server.compare_exchange_strong(expected, this)) {
+            this->instance = node;
+            return;
+        }
+    }
+    this->instance = new Instance;
+    this->instance->server.store(this);
+    this->instance->next = Server::instances.load();
+    while (!Server::instances.compare_exchange_weak(this->instance->next, this->instance));
+}
+
+/// @brief Returns "true" if the server's socket was created with "reuse_port".
+bool Server::has_reuse_port(void) {
+    int reuse_port = 0;
+    socklen_t optlen = sizeof(reuse_port);
+    if (getsockopt(this->socket.get_sockfd(), SOL_SOCKET, SO_REUSEPORT, &reuse_port, &optlen) == -1) {
+        perror(ERROR("getsockopt in Server::has_reuse_port"));
+        return false;
+    }
+    return reuse_port != 0;
+}
+
+/// @brief Thread function for Server::start_threaded().
+/// @param worker Pointer to the Worker to run.
+void* Server::run_thread(void* worker) {
+    Worker* w = (Worker*) worker;
+    w->server->run_worker(w->index, w->pin_cpu);
+    return NULL;
+}
+
+/// @brief Body of a worker process or thread. Opens its own listening socket,
+///  with the same address as the server, and attends clients until the server
+///  is stopped.
+/// @param index Worker number, used to choose the CPU.
+/// @param pin_cpu If "true", pin the worker to a single CPU.
+void Server::run_worker(int index, bool pin_cpu) {
+    char ip[INET6_ADDRSTRLEN], port[8];
+    int family, socktype;
+    socklen_t optlen = sizeof(int);
+    cpu_set_t cpus;
+
+    if (pin_cpu) {
+        CPU_ZERO(&cpus);
+        CPU_SET(index % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+        // Only affects the calling thread.
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+            perror(WARNING("sched_setaffinity in Server::run_worker"));
+        }
+    }
+    this->socket.get_my_ip(ip);
+    snprintf(port, sizeof(port), "%d", this->socket.get_my_port());
+    getsockopt(this->socket.get_sockfd(), SOL_SOCKET, SO_DOMAIN, &family, &optlen);
+    optlen = sizeof(int);
+    getsockopt(this->socket.get_sockfd(), SOL_SOCKET, SO_TYPE, &socktype, &optlen);
+    try {
+        Socket listener(ip, port, family, socktype, true, true, this->socket.get_profile());
+        if (this->socket.get_fastopen() > 0) {
+            listener.set_fastopen(this->socket.get_fastopen());
+        }
+        if (listen(listener.get_sockfd(), this->backlog) != 0) {
+            perror(ERROR("Couldn't start the worker with listen"));
+            return;
+        }
+        this->serve(listener);
+        listener.close();
+    } catch (std::runtime_error&) {
+        fprintf(stderr, ERROR("Couldn't create the worker's socket\n"));
+    }
+}
+
+/// @brief Waits until there is a client to accept on "listener", or until the
+///  server is stopped.
+/// @param listener Listening socket.
+/// @param sigmask If not NULL, signal mask used while waiting, as in "ppoll()".
+/// @return "0" if there is a client to accept, "-1" if the server was stopped,
+///  the wait was interrupted by a signal, or on error.
+int Server::wait_client(Socket& listener, const sigset_t* sigmask) {
+    struct pollfd pfd[2];
+    pfd[0].fd = listener.get_sockfd();
+    pfd[0].events = POLLIN;
+    pfd[1].fd = this->stop_fd;
+    pfd[1].events = POLLIN;
+    if (ppoll(pfd, 2, NULL, sigmask) == -1) {
+        if (errno != EINTR) {
+            perror(ERROR("ppoll in Server::wait_client"));
+        }
+        return -1;
+    }
+    return (pfd[1].revents) ? -1 : 0;
+}
+
+/// @brief Accepts clients from "listener" and attends them in the calling
+///  thread, one after the other, until the server is stopped. SIGINT must be
+///  blocked by the caller: it is only received while waiting for a new
+///  client, so the current one is always attended until the end.
+/// @param listener Listening socket.
+void Server::serve(Socket& listener) {
+    int client_sockfd;
+    Socket client_socket;
+    struct sockaddr_storage client_addr;
+    socklen_t addrlen;
+    sigset_t wait_mask;
+
+    pthread_sigmask(SIG_SETMASK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGINT);
+    while (!this->exit) {
+        if (this->wait_client(listener, &wait_mask) == -1) {
+            continue;
+        }
+        addrlen = sizeof(struct sockaddr_storage);
+        if ( (client_sockfd = accept(listener.get_sockfd(), (struct sockaddr*) &client_addr, &addrlen) ) == -1) {
+            if (errno != EINTR && errno != EAGAIN) {
+                perror(WARNING("Couldn't accept a connection from a client"));
+            }
+            continue;
+        }
+        if (this->init_client(client_socket, client_sockfd, (struct sockaddr*) &client_addr, addrlen) == -1) {
+            client_socket.close();
+            continue;
+        }
+        this->on_new_client();
+        this->on_accept(client_socket);
+        client_socket.close();
+    }
+}
+
+/******************************************************************************
+ * io_uring
+******************************************************************************/
+
+// Operation of each io_uring completion, stored in the upper half of "user_data".
+enum {URING_ACCEPT = 1, URING_READ, URING_WRITE, URING_STOP, URING_CANCEL, URING_DRAIN};
+
+/// @brief Starts the server in io_uring mode, blocks operation. Clients are
+///  accepted with a multishot accept, and every read and write goes through
+///  the ring, using registered buffers. All the operations prepared while
+///  attending completions are submitted together, with a single system call.
+///  Data from a client is received with "on_recv()", replies are sent with
+///  "queue_write()", and "on_close()" is called when a client leaves.
+///  If io_uring is not available, the event loop is used instead, with the
+///  same functions. The server keeps running until it is stopped. Then, the
+///  replies still being sent get up to one second before their clients are
+///  closed.
+/// @param backlog Number of clients that can be put "on hold".
+/// @param max_clients Maximum number of clients attended at the same time.
+///  Clients above this limit are closed as soon as they are accepted.
+/// @param buffer_size Size of the read buffer and of the write buffer of each
+///  client.
+void Server::start_uring(int backlog, int max_clients, int buffer_size) {
+    UringLoop loop;
+    std::vector<struct iovec> iov(2 * max_clients);
+    URing* ring = NULL;
+
+    if (URing::is_supported()) {
+        try {
+            ring = new URing(2 * max_clients + 2);
+        } catch (std::runtime_error&) {
+            ring = NULL;
+        }
+    }
+    loop.buffers.resize((ring != NULL) ? 2 * (size_t) max_clients * buffer_size : 0);
+    for (int i = 0; ring != NULL && i < 2 * max_clients; i++) {
+        iov[i].iov_base = &loop.buffers[(size_t) i * buffer_size];
+        iov[i].iov_len = buffer_size;
+    }
+    if (ring != NULL && ring->register_buffers(iov.data(), iov.size()) == -1) {
+        delete ring;
+        ring = NULL;
+    }
+    if (ring == NULL) {
+        fprintf(stderr, WARNING("io_uring not available in Server::start_uring. Using the event loop\n"));
+        this->recv_size = buffer_size;
+        this->start_event_loop(backlog);
+        this->recv_size = 0;
+        return;
+    }
+    loop.ring = ring;
+    loop.buffer_size = buffer_size;
+    loop.multishot = true;
+    loop.drain.tv_sec = 1;
+    loop.drain.tv_nsec = 0;
+    loop.clients.resize(max_clients);
+    for (int i = max_clients - 1; i >= 0; i--) {
+        loop.clients[i].socket = NULL;
+        loop.free_slots.push_back(i);
+    }
+    this->backlog = backlog;
+    this->on_start();
+    if (listen(this->socket.get_sockfd(), this->backlog) != 0) {
+        perror(ERROR("Couldn't start the server with listen"));
+    } else {
+        this->uring_loop(&loop);
+    }
+    delete ring;
+    this->socket.close();
+    this->on_quit();
+}
+
+/// @brief io_uring mode only. Copies "data" to the client's write buffer, and
+///  sends it through the ring. In the event loop fallback, it's the same as
+///  Socket::write() on a non-blocking socket.
+/// @param socket Client socket, as received in "on_recv()".
+/// @param data Bytes to send.
+/// @param len Amount of bytes to send.
+/// @return "len" on success, or "-1" if the write buffer can't hold "data",
+///  or on error.
+int Server::queue_write(Socket& socket, const void* data, int len) {
+    UringLoop* loop = Server::current_uring;
+    std::map<Socket*, int>::iterator it;
+    UringClient* client;
+    if (loop == NULL) {
+        return socket.write((void*) data, len);
+    }
+    if ( (it = loop->slots.find(&socket)) == loop->slots.end()) {
+        return -1;
+    }
+    client = &loop->clients[it->second];
+    if (client->closing || client->pending + len > loop->buffer_size) {
+        return -1;
+    }
+    memcpy(&loop->buffers[(2 * (size_t) it->second + 1) * loop->buffer_size + client->pending], data, len);
+    client->pending += len;
+    if (!client->writing) {
+        this->uring_write(loop, it->second);
+    }
+    return len;
+}
+
+/// @brief Submits the prepared operations and attends completions, until the
+///  server is stopped. Cancels the accept, closing the clients accepted in the
+///  meantime, and closes the remaining clients before returning.
+void Server::uring_loop(UringLoop* loop) {
+    struct io_uring_cqe* cqe;
+    uint64_t user_data;
+    unsigned flags;
+    int res;
+
+    Server::current_uring = loop;
+    loop->ring->prep_accept(this->socket.get_sockfd(), loop->multishot, (uint64_t) URING_ACCEPT << 32);
+    loop->accepting = true;
+    loop->ring->prep_poll(this->stop_fd, POLLIN, (uint64_t) URING_STOP << 32);
+    while (!this->exit || this->uring_writing(loop)) {
+        if (loop->ring->submit(1) == -1 && errno != EINTR) {
+            break;
+        }
+        while ( (cqe = loop->ring->peek()) != NULL) {
+            user_data = cqe->user_data;
+            res = cqe->res;
+            flags = cqe->flags;
+            loop->ring->seen();
+            this->uring_complete(loop, user_data, res, flags);
+        }
+    }
+    if (loop->accepting) {
+        loop->ring->prep_cancel((uint64_t) URING_ACCEPT << 32, (uint64_t) URING_CANCEL << 32);
+    }
+    while (loop->accepting) {
+        if (loop->ring->submit(1) == -1 && errno != EINTR) {
+            break;
+        }
+        while ( (cqe = loop->ring->peek()) != NULL) {
+            user_data = cqe->user_data;
+            res = cqe->res;
+            flags = cqe->flags;
+            loop->ring->seen();
+            if ((user_data >> 32) != URING_ACCEPT) {
+                continue;
+            }
+            if (res >= 0) {
+                ::close(res);
+            }
+            loop->accepting = (flags & IORING_CQE_F_MORE) != 0;
+        }
+    }
+    for (size_t i = 0; i < loop->clients.size(); i++) {
+        if (loop->clients[i].socket != NULL) {
+            this->on_close(*loop->clients[i].socket);
+            delete loop->clients[i].socket;
+            loop->clients[i].socket = NULL;
+        }
+    }
+    Server::current_uring = NULL;
+}
+
+/// @brief Checks if any client is still sending, so the replies queued before
+///  stopping the server are not lost.
+bool Server::uring_writing(UringLoop* loop) {
+    for (size_t i = 0; i < loop->clients.size(); i++) {
+        if (loop->clients[i].socket != NULL && loop->clients[i].writing) {
+            return true;
+        }
+    }
+    return false;
 }
+
+/// @brief Attends one completion.
+/// @param user_data Operation in the upper 32 bits, client slot in the lower.
+/// @param res Result of the operation.
+/// @param flags Completion flags.
+void Server::uring_complete(UringLoop* loop, uint64_t user_data, int res, unsigned flags) {
+    int slot = (int) (user_data & 0xffffffff);
+    UringClient* client = &loop->clients[slot];
+    char* buffer;
+
+    switch (user_data >> 32) {
+        case URING_ACCEPT:
+            if (res == -EINVAL && loop->multishot) {
+                // Kernel without multishot accept, one accept per client.
+                loop->multishot = false;
+            } else if (res >= 0 && this->exit) {
+                ::close(res);
+            } else if (res >= 0) {
+                this->uring_new_client(loop, res);
+            }
+            loop->accepting = (flags & IORING_CQE_F_MORE) != 0;
+            if (!loop->accepting && !this->exit) {
+                loop->ring->prep_accept(this->socket.get_sockfd(), loop->multishot, (uint64_t) URING_ACCEPT << 32);
+                loop->accepting = true;
+            }
+        break;
+        case URING_READ:
+            client->inflight--;
+            if (res <= 0 || client->closing) {
+                this->uring_release(loop, slot);
+                break;
+            }
+            buffer = &loop->buffers[2 * (size_t) slot * loop->buffer_size];
+            this->on_recv(*client->socket, buffer, res);
+            if (client->socket != NULL && !client->closing) {
+                this->uring_read(loop, slot);
+            }
+        break;
+        case URING_WRITE:
+            client->inflight--;
+            client->writing = false;
+            if (res < 0 || client->closing) {
+                this->uring_release(loop, slot);
+                break;
+            }
+            buffer = &loop->buffers[(2 * (size_t) slot + 1) * loop->buffer_size];
+            memmove(buffer, buffer + res, client->pending - res);
+            client->pending -= res;
+            if (client->pending > 0) {
+                this->uring_write(loop, slot);
+            }
+        break;
+        case URING_STOP:
+            this->exit = true;
+            loop->ring->prep_timeout(&loop->drain, (uint64_t) URING_DRAIN << 32);
+        break;
+        case URING_DRAIN:
+            // A peer that doesn't read would keep its write in the ring forever.
+            // Canceled writes fail, and their clients are released then.
+            for (size_t i = 0; i < loop->clients.size(); i++) {
+                if (loop->clients[i].socket != NULL && loop->clients[i].writing) {
+                    loop->ring->prep_cancel((uint64_t) URING_WRITE << 32 | i, (uint64_t) URING_CANCEL << 32);
+                }
+            }
+        break;
+    }
+}
+
+/// @brief Gives a slot to a new client, and starts reading from it.
+/// @param sockfd Accepted socket.
+void Server::uring_new_client(UringLoop* loop, int sockfd) {
+    struct sockaddr_storage client_addr;
+    socklen_t addrlen = sizeof(struct sockaddr_storage);
+    UringClient* client;
+    int slot;
+
+    if (loop->free_slots.empty()) {
+        fprintf(stderr, WARNING("Too many clients in Server::start_uring. Connection closed\n"));
+        ::close(sockfd);
+        return;
+    }
+    if (getpeername(sockfd, (struct sockaddr*) &client_addr, &addrlen) == -1) {
+        perror(WARNING("getpeername in Server::uring_new_client"));
+        ::close(sockfd);
+        return;
+    }
+    slot = loop->free_slots.back();
+    client = &loop->clients[slot];
+    client->socket = new Socket();
+    if (this->init_client(*client->socket, sockfd, (struct sockaddr*) &client_addr, addrlen) == -1) {
+        delete client->socket;
+        client->socket = NULL;
+        return;
+    }
+    loop->free_slots.pop_back();
+    loop->slots[client->socket] = slot;
+    client->inflight = 0;
+    client->closing = false;
+    client->writing = false;
+    client->pending = 0;
+    this->on_new_client();
+    this->uring_read(loop, slot);
+}
+
+/// @brief Prepares a read into the client's registered read buffer.
+void Server::uring_read(UringLoop* loop, int slot) {
+    UringClient* client = &loop->clients[slot];
+    if (loop->ring->prep_read_fixed(client->socket->get_sockfd(), &loop->buffers[2 * (size_t) slot * loop->buffer_size],
+            loop->buffer_size, 2 * slot, ((uint64_t) URING_READ << 32) | slot) == -1) {
+        this->uring_release(loop, slot);
+        return;
+    }
+    client->inflight++;
+}
+
+/// @brief Prepares a write of the whole client's write buffer.
+void Server::uring_write(UringLoop* loop, int slot) {
+    UringClient* client = &loop->clients[slot];
+    if (loop->ring->prep_write_fixed(client->socket->get_sockfd(), &loop->buffers[(2 * (size_t) slot + 1) * loop->buffer_size],
+            client->pending, 2 * slot + 1, ((uint64_t) URING_WRITE << 32) | slot) == -1) {
+        this->uring_release(loop, slot);
+        return;
+    }
+    client->inflight++;
+    client->writing = true;
+}
+
+/// @brief Closes a client. The operations still in the ring are finished by
+///  a "shutdown()", and the client is released after the last of them.
+void Server::uring_release(UringLoop* loop, int slot) {
+    UringClient* client = &loop->clients[slot];
+    if (client->socket == NULL) {
+        return;
+    }
+    if (!client->closing) {
+        client->closing = true;
+        shutdown(client->socket->get_sockfd(), SHUT_RDWR);
+    }
+    if (client->inflight > 0) {
+        return;
+    }
+    this->on_close(*client->socket);
+    loop->slots.erase(client->socket);
+    delete client->socket;
+    client->socket = NULL;
+    loop->free_slots.push_back(slot);
+}
+
+/******************************************************************************
+ * Datagrams
+******************************************************************************/
+
+/// @brief Starts a datagram ("SOCK_DGRAM") server, blocks operation. Packets
+///  are received in batches with a single "recvmmsg()", and "on_datagram()"
+///  is called for each one. The replies queued with "queue_datagram()" are
+///  sent together with a single "sendmmsg()" after every batch. The server
+///  keeps running until it is stopped.
+/// @param batch Maximum amount of packets received, or replies sent, with
+///  one system call.
+/// @param buffer_size Maximum size of a packet. Longer packets are truncated.
+void Server::start_datagram(int batch, int buffer_size) {
+    Datagrams datagrams;
+    int i, received;
+
+    datagrams.msgs_in.resize(batch);
+    datagrams.msgs_out.resize(batch);
+    datagrams.iov_in.resize(batch);
+    datagrams.iov_out.resize(batch);
+    datagrams.addr_in.resize(batch);
+    datagrams.addr_out.resize(batch);
+    datagrams.buffers_in.resize((size_t) batch * buffer_size);
+    datagrams.buffers_out.resize((size_t) batch * buffer_size);
+    datagrams.buffer_size = buffer_size;
+    datagrams.pending = 0;
+    memset(datagrams.msgs_in.data(), 0, batch * sizeof(struct mmsghdr));
+    memset(datagrams.msgs_out.data(), 0, batch * sizeof(struct mmsghdr));
+    for (i = 0; i < batch; i++) {
+        datagrams.iov_in[i].iov_base = &datagrams.buffers_in[(size_t) i * buffer_size];
+        datagrams.iov_in[i].iov_len = buffer_size;
+        datagrams.msgs_in[i].msg_hdr.msg_iov = &datagrams.iov_in[i];
+        datagrams.msgs_in[i].msg_hdr.msg_iovlen = 1;
+        datagrams.msgs_in[i].msg_hdr.msg_name = &datagrams.addr_in[i];
+        datagrams.iov_out[i].iov_base = &datagrams.buffers_out[(size_t) i * buffer_size];
+        datagrams.msgs_out[i].msg_hdr.msg_iov = &datagrams.iov_out[i];
+        datagrams.msgs_out[i].msg_hdr.msg_iovlen = 1;
+        datagrams.msgs_out[i].msg_hdr.msg_name = &datagrams.addr_out[i];
+    }
+    Server::current_datagrams = &datagrams;
+    this->on_start();
+    while (!this->exit) {
+        if (this->wait_client(this->socket) == -1) {
+            continue;
+        }
+        for (i = 0; i < batch; i++) {
+            datagrams.msgs_in[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+        if ( (received = this->socket.read_batch(datagrams.msgs_in.data(), batch, MSG_DONTWAIT) ) == -1) {
+            continue;
+        }
+        for (i = 0; i < received; i++) {
+            this->on_datagram(datagrams.iov_in[i].iov_base, datagrams.msgs_in[i].msg_len,
+                (struct sockaddr*) &datagrams.addr_in[i], datagrams.msgs_in[i].msg_hdr.msg_namelen);
+        }
+        this->flush_datagrams(&datagrams);
+    }
+    this->flush_datagrams(&datagrams);
+    Server::current_datagrams = NULL;
+    this->socket.close();
+    this->on_quit();
+}
+
+/// @brief Datagram mode only. Queues a packet for "peer", sent with the rest
+///  of the replies after the current batch. Outside the datagram mode, the
+///  packet is sent right away.
+/// @param data Bytes to send.
+/// @param len Amount of bytes to send, not longer than "buffer_size".
+/// @param peer Destination, as received in "on_datagram()".
+/// @param peer_len Size of "peer".
+/// @return "len" on success, or "-1" on error.
+int Server::queue_datagram(const void* data, int len, const struct sockaddr* peer, socklen_t peer_len) {
+    Datagrams* datagrams = Server::current_datagrams;
+    if (datagrams == NULL) {
+        if (sendto(this->socket.get_sockfd(), data, len, MSG_NOSIGNAL, peer, peer_len) == -1) {
+            perror(ERROR("sendto in Server::queue_datagram"));
+            return -1;
+        }
+        return len;
+    }
+    if (len > datagrams->buffer_size || peer_len > sizeof(struct sockaddr_storage)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (datagrams->pending == (int) datagrams->msgs_out.size()) {
+        this->flush_datagrams(datagrams);
+    }
+    memcpy(datagrams->iov_out[datagrams->pending].iov_base, data, len);
+    datagrams->iov_out[datagrams->pending].iov_len = len;
+    memcpy(&datagrams->addr_out[datagrams->pending], peer, peer_len);
+    datagrams->msgs_out[datagrams->pending].msg_hdr.msg_namelen = peer_len;
+    datagrams->pending++;
+    return len;
+}
+
+/// @brief Sends the queued replies. Like any datagram, the ones that can't be
+///  sent are dropped.
+/// @return Amount of replies sent, or "-1" on error.
+int Server::flush_datagrams(Datagrams* datagrams) {
+    int sent = 0;
+    if (datagrams->pending > 0) {
+        sent = this->socket.write_batch(datagrams->msgs_out.data(), datagrams->pending);
+        datagrams->pending = 0;
+    }
+    return sent;
+}
+
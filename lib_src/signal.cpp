@@ -51,8 +51,11 @@ int Signal::set_default_handler(int signal) {
 
 /// @brief Blocks a signal. The signal will be pending until unblocked, if received.
 /// @param signal Signal number.
+/// @param old_mask If not NULL, where the previous mask of the thread is
+///  stored, to put it back with restore_mask() instead of unblocking a signal
+///  the thread had blocked on purpose (NULL by default).
 /// @return "0" on success, "-1" on error.
-int Signal::block(int signal) {
+int Signal::block(int signal, sigset_t* old_mask) {
     sigset_t mask;
     if (sigemptyset(&mask) != 0) {
         perror(ERROR("sigemptyset in Signal::block"));
@@ -62,7 +65,7 @@ int Signal::block(int signal) {
         perror(ERROR("sigaddset in Signal::block"));
         return -1;
     }
-    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+    if (pthread_sigmask(SIG_BLOCK, &mask, old_mask) != 0) {
         perror((ERROR("pthread_sigmask in Signal::block")));
         return -1;
     }
@@ -89,6 +92,17 @@ int Signal::unblock(int signal) {
     return 0;
 }
 
+/// @brief Sets the signal mask of the thread back to one saved by block().
+/// @param old_mask Mask to restore.
+/// @return "0" on success, "-1" on error.
+int Signal::restore_mask(const sigset_t* old_mask) {
+    if (pthread_sigmask(SIG_SETMASK, old_mask, NULL) != 0) {
+        perror((ERROR("pthread_sigmask in Signal::restore_mask")));
+        return -1;
+    }
+    return 0;
+}
+
 /// @brief Unblocks all signal, initializes the signal mask.
 /// @return "0" on success, "-1" on error.
 int Signal::unblock_all(void) {
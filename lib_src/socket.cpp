@@ -6,136 +6,382 @@
 
 /// @brief Creates a socket.
 /// @param ip The IP address of the device, as a string. It can be IPv4 or IPv6.
-///  If null, it will use any IP from the device.
+///  If null, it will use any IP from the device. With AF_UNIX, the path of the
+///  socket, or a name starting with '@' for the abstract namespace.
 /// @param port Port number as a string, or any protocol defined in "/etc/services".
-///   For example, "http" is the protocol related to the port "80/tcp".
+///   For example, "http" is the protocol related to the port "80/tcp". Ignored
+///   with AF_UNIX.
 /// @param family It can be:
 ///  * AF_INET;   For IPv4.
 ///  * AF_INET6;  For IPv6.
 ///  * AF_UNSPEC; Any.
+///  * AF_UNIX;   For Unix domain sockets, in the same host. A server replaces
+///  any socket file left at "ip".
 /// @param socktype It can be:
 ///  * SOCK_STREAM; For TCP.
 ///  * SOCK_DGRAM;  For UDP.
+///  * SOCK_SEQPACKET; Only with AF_UNIX, for messages over a connection.
 /// @param server If "true", this socket will be opened to be used as a server.
 ///  If "false", it will be used to connect to other socket.
+/// @param reuse_port Only for servers. If "true", "SO_REUSEPORT" is set, so
+///  several sockets can be bound to the same IP and port, and the kernel
+///  balances the incoming connections between them ("false" by default).
+/// @param profile Socket options set before binding or connecting, see
+///  Socket::set_profile() ("SOCKET_PROFILE_DEFAULT" by default). Sockets
+///  accepted by a server inherit them, except "TCP_QUICKACK".
 /// @return Might throw std::runtime_error on error.
-Socket::Socket(const char* ip, const char* port, int family, int socktype, bool server) {
-    struct addrinfo hints;
-    struct addrinfo* res, *p;
+Socket::Socket(const char* ip, const char* port, int family, int socktype, bool server, bool reuse_port,
+        SocketProfile profile):
+    peer_addrlen(0), zerocopy(false), zerocopy_min(0), zerocopy_next(0), zerocopy_pending(0),
+    profile(SOCKET_PROFILE_DEFAULT), busy_poll(0), quickack(false), path_owner(0) {
+    std::vector<Resolver::Address> addrs;
+    std::vector<Resolver::Address>::iterator p;
+    struct sockaddr* addr;
     int yes=1;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = family;       // IP type.
-    hints.ai_socktype = socktype;   // TCP o UDP.
-    hints.ai_protocol = 0;          // If "0", same protocol as "socktype".
-    hints.ai_flags = (ip == NULL) ? AI_PASSIVE : 0; // if "AI_PASSIVE", listen on any IP.
-    if (getaddrinfo(ip, port, &hints, &res) != 0) {
-        perror (ERROR("getaddrinfo in Socket::Socket"));
+    int status;
+    if (family == AF_UNIX) {
+        this->init_unix(ip, socktype, server);
+        if (profile != SOCKET_PROFILE_DEFAULT) {
+            this->set_profile(profile);
+        }
+        return;
+    }
+    // if "ip" is NULL, listen on any IP.
+    if ( (status = Resolver::resolve(ip, port, family, socktype, addrs) ) != 0) {
+        fprintf(stderr, ERROR("getaddrinfo in Socket::Socket: %s\n"), gai_strerror(status));
         throw(std::runtime_error("getaddrinfo"));
     }
-    for (p = res; p != NULL; p = p->ai_next) {
-        if ( (this->sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol) ) == -1) {
+    for (p = addrs.begin(); p != addrs.end(); p++) {
+        addr = (struct sockaddr*) &p->addr;
+        if ( (this->sockfd = socket(p->family, p->socktype, p->protocol) ) == -1) {
             perror(WARNING("socket in Socket::Socket. Failed connection to one of the sockets"));
             continue;
         }
+        // Buffer sizes must be set before the handshake to scale the window.
+        if (profile != SOCKET_PROFILE_DEFAULT) {
+            this->set_profile(profile);
+        }
         if (server) {
             if (setsockopt(this->sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes) ) == -1) {
                 perror(WARNING("setsockopt in Socket::Socket. Trying to reuse port"));
                 ::close(this->sockfd);
                 continue;
             }
-            if (bind(this->sockfd, p->ai_addr, p->ai_addrlen) == -1) {
-                perror(WARNING("bind in Socket::Socket"));
+            if (reuse_port && setsockopt(this->sockfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes) ) == -1) {
+                perror(WARNING("setsockopt in Socket::Socket. Trying to share port"));
                 ::close(this->sockfd);
                 continue;
             }
-            // For a server socket, own IP and peer IP are equal.
-            if (this->get_ip_from_sockaddr(this->my_ip, p->ai_addr) == -1) {
+            if (bind(this->sockfd, addr, p->addrlen) == -1) {
+                perror(WARNING("bind in Socket::Socket"));
+                ::close(this->sockfd);
                 continue;
             }
-            this->my_port = this->get_port_from_sockaddr(p->ai_addr);
-            this->get_my_ip(this->peer_ip);
-            this->peer_port = this->get_my_port();
+            // For a server socket, own IP and peer IP are equal.
+            this->set_peer_addr(addr, p->addrlen);
         } else {
-            if (connect(this->sockfd, p->ai_addr, p->ai_addrlen) == -1) {
+            if (::connect(this->sockfd, addr, p->addrlen) == -1) {
                 perror(WARNING("Couldn't connect to one of the sockets"));
                 ::close(this->sockfd);
                 continue;
             }
-            this->get_ip_from_sockfd(this->sockfd, this->my_ip);
-            this->my_port = this->get_port_from_sockfd(this->sockfd);
-            this->get_ip_from_sockaddr(this->peer_ip, p->ai_addr);
-            this->peer_port = this->get_port_from_sockaddr(p->ai_addr);
+            this->set_peer_addr(addr, p->addrlen);
         }
         break;
     }
-    if (p == NULL) {
+    if (p == addrs.end()) {
         fprintf(stderr, ERROR("Couldn't create the socket"));
         throw(std::runtime_error("Socket"));
     }
-    freeaddrinfo(res);
 }
 
-/// @brief Copy constructor.
-Socket::Socket(const Socket &socket) {
-    this->sockfd = socket.get_sockfd();
-    socket.get_my_ip(this->my_ip);
-    this->my_port = socket.get_my_port();
-    socket.get_peer_ip(this->peer_ip);
-    this->peer_port = socket.get_peer_port();
+/// @brief Move constructor. "socket" is left closed, and only this one
+///  closes the file descriptor.
+Socket::Socket(Socket&& socket): sockfd(-1) {
+    *this = std::move(socket);
 }
 
 /// @brief Empty constructor. Must call Socket::init(). Used after a successful
 ///  call to "accept".
-Socket::Socket() {}
+Socket::Socket(): sockfd(-1), peer_addrlen(0), zerocopy(false), zerocopy_min(0), zerocopy_next(0),
+    zerocopy_pending(0), profile(SOCKET_PROFILE_DEFAULT), busy_poll(0), quickack(false), path_owner(0) {}
 
-/// @brief Creates a socket from a successful call to "accept()".
+/// @brief Move assignment. Closes the file descriptor of this socket, if any,
+///  and takes the one of "socket", which is left closed.
+Socket& Socket::operator= (Socket&& socket) {
+    if (this == &socket) {
+        return *this;
+    }
+    if (this->sockfd != -1) {
+        this->remove_path();
+        ::close(this->sockfd);
+    }
+    this->sockfd = socket.sockfd;
+    this->set_peer_addr((struct sockaddr*) &socket.peer_addr, socket.peer_addrlen);
+    this->zerocopy = socket.zerocopy;
+    this->zerocopy_min = socket.zerocopy_min;
+    this->zerocopy_next = socket.zerocopy_next;
+    this->zerocopy_pending = socket.zerocopy_pending;
+    this->profile = socket.profile;
+    this->busy_poll = socket.busy_poll;
+    this->quickack = socket.quickack;
+    this->path_owner = socket.path_owner;
+    socket.sockfd = -1;
+    socket.path_owner = 0;
+    return *this;
+}
+
+/// @brief Creates a socket from a successful call to "accept()". Only the
+///  address of the peer is stored, IPs and ports are formatted when asked for.
 /// @param sockfd Socket file descriptor.
 /// @param addr struct sockaddr from the "accept()" call.
+/// @param addrlen Size of "addr", as returned by "accept()". If "0", it's taken
+///  from the family of "addr", or from "getpeername()" for AF_UNIX.
 /// @return "0" on success, "-1" on error.
-int Socket::init(int sockfd, struct sockaddr* addr) {
+int Socket::init(int sockfd, struct sockaddr* addr, socklen_t addrlen) {
     this->sockfd = sockfd;
-    if (this->get_ip_from_sockfd(sockfd, this->my_ip) == -1) {
+    this->zerocopy = false;
+    this->zerocopy_next = 0;
+    this->zerocopy_pending = 0;
+    this->profile = SOCKET_PROFILE_DEFAULT;
+    this->busy_poll = 0;
+    this->quickack = false;
+    this->path_owner = 0;
+    if (addrlen == 0 && addr->sa_family == AF_INET) {
+        addrlen = sizeof(struct sockaddr_in);
+    } else if (addrlen == 0 && addr->sa_family == AF_INET6) {
+        addrlen = sizeof(struct sockaddr_in6);
+    } else if (addrlen == 0 && addr->sa_family == AF_UNIX) {
+        // Unnamed peers have a shorter address.
+        this->peer_addrlen = sizeof(this->peer_addr);
+        if (getpeername(sockfd, (struct sockaddr*) &this->peer_addr, &this->peer_addrlen) == -1) {
+            perror(ERROR("getpeername in Socket::init"));
+            this->peer_addrlen = 0;
+            return -1;
+        }
+        return 0;
+    } else if (addrlen == 0) {
+        fprintf(stderr, ERROR("Unknown address family in Socket::init\n"));
+        this->peer_addrlen = 0;
         return -1;
     }
-    this->my_port = this->get_port_from_sockfd(sockfd);
-    if (this->get_ip_from_sockaddr(this->peer_ip, addr) == -1) {
+    this->set_peer_addr(addr, addrlen);
+    return 0;
+}
+
+/// @brief Connects to a server within a deadline, racing the addresses of
+///  "ip" ("Happy Eyeballs", RFC 8305). Addresses are tried alternating IPv6
+///  and IPv4, starting a new non-blocking "connect()" every "stagger_ms", or
+///  right away when the previous ones failed. The first connection
+///  established is kept, and the rest are closed. The socket must not be
+///  open: use it on an empty Socket, or after Socket::close().
+/// @param ip IP address or host name of the server.
+/// @param port Port number as a string, or any protocol defined in "/etc/services".
+/// @param timeout_ms Milliseconds to wait for a connection.
+/// @param family AF_INET, AF_INET6 or AF_UNSPEC (default) for both.
+/// @param socktype SOCK_STREAM (default) or SOCK_DGRAM.
+/// @param stagger_ms Delay before trying the next address while the previous
+///  ones are in progress ("250" by default).
+/// @return "0" on success, "-1" on error. "-1" with errno "ETIMEDOUT" if no
+///  address could be connected before the deadline. The socket is left in
+///  blocking mode, as if it were created with the constructor.
+int Socket::connect(const char* ip, const char* port, int timeout_ms, int family, int socktype, int stagger_ms) {
+    std::vector<Resolver::Address> resolved;
+    std::vector<Resolver::Address*> addrs, others;
+    Resolver::Address* p;
+    std::vector<struct pollfd> attempts;
+    struct timespec now;
+    long long now_ms, deadline, next_start;
+    size_t next = 0, i;
+    int sockfd = -1, error = ETIMEDOUT, wait_ms;
+    socklen_t optlen;
+
+    if (this->sockfd != -1) {
+        errno = EISCONN;
         return -1;
     }
-    this->peer_port = this->get_port_from_sockaddr(addr);
+    if ( (error = Resolver::resolve(ip, port, family, socktype, resolved) ) != 0) {
+        fprintf(stderr, ERROR("getaddrinfo in Socket::connect: %s\n"), gai_strerror(error));
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    // Alternate families, starting with the one preferred by getaddrinfo().
+    for (i = 0; i < resolved.size(); i++) {
+        ((resolved[i].family == resolved[0].family) ? addrs : others).push_back(&resolved[i]);
+    }
+    error = ETIMEDOUT;
+    for (i = 0; i < others.size(); i++) {
+        addrs.insert(addrs.begin() + std::min(2 * i + 1, addrs.size()), others[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    deadline = now_ms + timeout_ms;
+    next_start = now_ms;
+    while (sockfd == -1 && now_ms < deadline && (next < addrs.size() || !attempts.empty())) {
+        if (next < addrs.size() && now_ms >= next_start) {
+            p = addrs[next++];
+            struct pollfd attempt = {-1, POLLOUT, 0};
+            next_start = now_ms + stagger_ms;
+            if ( (attempt.fd = socket(p->family, p->socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->protocol) ) == -1) {
+                error = errno;
+                next_start = now_ms;
+            } else if (::connect(attempt.fd, (struct sockaddr*) &p->addr, p->addrlen) == 0) {
+                sockfd = attempt.fd;
+                break;
+            } else if (errno == EINPROGRESS) {
+                attempts.push_back(attempt);
+            } else {
+                error = errno;
+                ::close(attempt.fd);
+                next_start = now_ms;
+            }
+            continue;
+        }
+        wait_ms = deadline - now_ms;
+        if (next < addrs.size() && next_start - now_ms < wait_ms) {
+            wait_ms = next_start - now_ms;
+        }
+        if (poll(attempts.data(), attempts.size(), wait_ms) == -1 && errno != EINTR) {
+            error = errno;
+            break;
+        }
+        for (i = 0; i < attempts.size() && sockfd == -1; ) {
+            if (attempts[i].revents == 0) {
+                i++;
+                continue;
+            }
+            optlen = sizeof(error);
+            if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &error, &optlen) == 0 && error == 0) {
+                sockfd = attempts[i].fd;
+            } else {
+                // Failed, so the next address doesn't have to wait.
+                ::close(attempts[i].fd);
+                next_start = now_ms;
+            }
+            attempts.erase(attempts.begin() + i);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        now_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    }
+    for (i = 0; i < attempts.size(); i++) {
+        ::close(attempts[i].fd);
+    }
+    if (sockfd == -1) {
+        errno = (now_ms >= deadline) ? ETIMEDOUT : error;
+        return -1;
+    }
+    this->sockfd = sockfd;
+    this->zerocopy = false;
+    this->zerocopy_next = 0;
+    this->zerocopy_pending = 0;
+    this->set_nonblocking(false);
+    this->peer_addrlen = sizeof(this->peer_addr);
+    if (getpeername(sockfd, (struct sockaddr*) &this->peer_addr, &this->peer_addrlen) == -1) {
+        this->peer_addrlen = 0;
+    }
     return 0;
 }
 
+/// @brief Connects to a TCP server sending "data" in the SYN with TCP Fast
+///  Open, which saves the round trip of the handshake when the client has a
+///  cookie of the server from a previous connection. Otherwise the kernel
+///  asks for a cookie and sends "data" after the handshake, as a regular
+///  connection would. If Fast Open is disabled for clients
+///  ("net.ipv4.tcp_fastopen"), it falls back to "connect()" and "send()". The
+///  socket must not be open, as in Socket::connect().
+/// @param ip IP address or host name of the server.
+/// @param port Port number as a string, or any protocol defined in "/etc/services".
+/// @param data First message for the server.
+/// @param len Length of "data" in bytes.
+/// @param family AF_INET, AF_INET6 or AF_UNSPEC (default) for both.
+/// @return Amount of bytes of "data" sent, or "-1" if no address could be
+///  connected.
+int Socket::connect_fastopen(const char* ip, const char* port, const void* data, int len, int family) {
+    std::vector<Resolver::Address> addrs;
+    std::vector<Resolver::Address>::iterator p;
+    int sockfd = -1, bytes_sent = -1, aux, status;
+
+    if (this->sockfd != -1) {
+        errno = EISCONN;
+        return -1;
+    }
+    if ( (status = Resolver::resolve(ip, port, family, SOCK_STREAM, addrs) ) != 0) {
+        fprintf(stderr, ERROR("getaddrinfo in Socket::connect_fastopen: %s\n"), gai_strerror(status));
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    for (p = addrs.begin(); p != addrs.end(); p++) {
+        if ( (sockfd = socket(p->family, p->socktype, p->protocol) ) == -1) {
+            perror(WARNING("socket in Socket::connect_fastopen"));
+            continue;
+        }
+        // Connects and sends at once. Don't generate SIGPIPE.
+        bytes_sent = sendto(sockfd, data, len, MSG_FASTOPEN | MSG_NOSIGNAL,
+            (struct sockaddr*) &p->addr, p->addrlen);
+        if (bytes_sent == -1 && (errno == EOPNOTSUPP || errno == ENOTSUP)) {
+            if (::connect(sockfd, (struct sockaddr*) &p->addr, p->addrlen) == 0) {
+                bytes_sent = send(sockfd, data, len, MSG_NOSIGNAL);
+            }
+        }
+        if (bytes_sent == -1) {
+            perror(WARNING("Couldn't connect to one of the sockets"));
+            ::close(sockfd);
+            continue;
+        }
+        break;
+    }
+    if (p == addrs.end()) {
+        return -1;
+    }
+    this->sockfd = sockfd;
+    this->zerocopy = false;
+    this->zerocopy_next = 0;
+    this->zerocopy_pending = 0;
+    this->set_peer_addr((struct sockaddr*) &p->addr, p->addrlen);
+    // Only part of it might fit in the SYN.
+    if (bytes_sent < len) {
+        if ( (aux = this->write((char*) data + bytes_sent, len - bytes_sent) ) == -1) {
+            return bytes_sent;
+        }
+        bytes_sent += aux;
+    }
+    return bytes_sent;
+}
+
 /// @brief Returns "true" if the socket is listening for connections. Same
 ///  parameters as constructor. The server will get a "recv()" with a "0" return
 /// value when this function is called.
 /// @return "true" if the socket is listening for connections.
 bool Socket::is_listening(const char* ip, const char* port, int family, int socktype) {
-    struct addrinfo hints;
-    struct addrinfo* res, *p;
+    std::vector<Resolver::Address> addrs;
+    std::vector<Resolver::Address>::iterator p;
     int sockfd;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = family;
-    hints.ai_socktype = socktype;
-    hints.ai_protocol = 0;
-    hints.ai_flags =  0;
-    if (getaddrinfo(ip, port, &hints, &res) != 0) {
+    struct sockaddr_un unix_addr;
+    socklen_t addrlen;
+    if (family == AF_UNIX) {
+        if (Socket::get_unix_addr(ip, &unix_addr, &addrlen) == -1 ||
+                (sockfd = socket(AF_UNIX, socktype, 0) ) == -1) {
+            return false;
+        }
+        addrlen = ::connect(sockfd, (struct sockaddr*) &unix_addr, addrlen);
+        ::close(sockfd);
+        return addrlen == 0;
+    }
+    if (Resolver::resolve(ip, port, family, socktype, addrs) != 0) {
         return false;
     }
-    for (p = res; p != NULL; p = p->ai_next) {
-        if ( (sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol) ) == -1) {
+    for (p = addrs.begin(); p != addrs.end(); p++) {
+        if ( (sockfd = socket(p->family, p->socktype, p->protocol) ) == -1) {
             continue;
         }
-        if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
+        if (::connect(sockfd, (struct sockaddr*) &p->addr, p->addrlen) == -1) {
             ::close(sockfd);
             continue;
         } else {
             ::close(sockfd);
-            freeaddrinfo(res);
             return true;
         }
     }
-    ::close(sockfd);
-    freeaddrinfo(res);
     return false;
 }
 
@@ -143,19 +389,29 @@ bool Socket::is_listening(const char* ip, const char* port, int family, int sock
  * Destructors and cleanup
 ******************************************************************************/
 
-/// @brief Closes the socket. Connection is not closed gracefully.
+/// @brief Closes the socket, if it wasn't closed already. Connection is not
+///  closed gracefully.
 Socket::~Socket() {
-    ::close(this->sockfd);
+    if (this->sockfd != -1) {
+        this->remove_path();
+        ::close(this->sockfd);
+    }
 }
 
-/// @brief Closes connection and cleans resources.
+/// @brief Closes connection and cleans resources. The file descriptor is
+///  released, so closing twice has no effect.
 void Socket::close(void) {
+    if (this->sockfd == -1) {
+        return;
+    }
     if (shutdown(this->sockfd, SHUT_RDWR) == -1) {
         perror(ERROR("shutdown in Socket::close"));
     }
     if (::close(this->sockfd) == -1) {
         perror(ERROR("close in Socket::close"));
     }
+    this->remove_path();
+    this->sockfd = -1;
 }
 
 /******************************************************************************
@@ -167,17 +423,37 @@ void Socket::close(void) {
 /// @param len Length of the message in bytes.
 /// @param flags See "man send" for all possible flags ("0" by default).
 /// @return Amount of bytes sent, or "-1" on error. If the socket was closed
-///  by the peer, it will raise the signal "SIGPIPE".
+///  by the peer, it will raise the signal "SIGPIPE". In non-blocking mode, it
+///  returns the amount of bytes sent before the socket buffer filled up, or
+///  "-1" with errno "EAGAIN" if nothing could be sent. In zero-copy mode,
+///  "msg" can't be modified until its sends complete, see set_zerocopy().
 int Socket::write(void* msg, int len, int flags) {
     int bytes_sent = 0;
     int aux;
+    bool zerocopy;
     do {
+        zerocopy = this->zerocopy && len - bytes_sent >= this->zerocopy_min;
         // Don't generate SIGPIPE, return with -1 if peer was closed
-        if ( (aux = send(this->sockfd, msg, len, flags | MSG_NOSIGNAL) ) == -1) {
+        aux = send(this->sockfd, (char*) msg + bytes_sent, len - bytes_sent,
+            flags | MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+        if (aux == -1 && zerocopy && errno == ENOBUFS) {
+            // Out of memory to pin pages, copy instead.
+            zerocopy = false;
+            aux = send(this->sockfd, (char*) msg + bytes_sent, len - bytes_sent, flags | MSG_NOSIGNAL);
+        }
+        if (aux == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                bytes_sent = (bytes_sent > 0) ? bytes_sent : -1;
+                break;
+            }
             perror(ERROR("send in Socket::write"));
             bytes_sent = aux;
             break;
         }
+        if (zerocopy) {
+            this->zerocopy_next++;
+            this->zerocopy_pending++;
+        }
         bytes_sent += aux;
     }while (bytes_sent < len);
     return bytes_sent;
@@ -188,11 +464,22 @@ int Socket::write(void* msg, int len, int flags) {
 /// @param len Length of the buffer "msg".
 /// @param flags See "man recv" ("0" by default).
 /// @return The amount of bytes received. "0" if the connection was closed
-///  correctly from the other end, or "-1" on error.
+///  correctly from the other end, or "-1" on error. In non-blocking mode, "-1"
+///  with errno "EAGAIN" means there is nothing to read yet. With
+///  set_busy_poll(), it spins before blocking, see there.
 int Socket::read(void* msg, int len, int flags) {
     int bytes_read = 0;
-    bytes_read = recv(this->sockfd, msg, len, flags);
-    if ( bytes_read == -1 ) {
+    if (this->busy_poll > 0 && !(flags & MSG_DONTWAIT)) {
+        bytes_read = this->read_busy_poll(msg, len, flags);
+    } else {
+        bytes_read = recv(this->sockfd, msg, len, flags);
+    }
+    if (bytes_read > 0 && this->quickack) {
+        // The kernel goes back to delayed ACKs by itself, so it's set again.
+        int yes = 1;
+        setsockopt(this->sockfd, IPPROTO_TCP, TCP_QUICKACK, &yes, sizeof(yes));
+    }
+    if ( bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
         perror(ERROR("recv in Socket::read"));
     } // else if (bytes_read == 0) {
     //     fprintf(stderr, INFO("The other socket was closed gracefully, or a zero length message was sent.\n"));
@@ -200,30 +487,555 @@ int Socket::read(void* msg, int len, int flags) {
     return bytes_read;
 }
 
+/// @brief Reads from the socket, like Socket::read(), and gets the time the
+///  kernel received the data, so the time spent in the stack can be told
+///  apart from the time spent in the application. Needs set_timestamping().
+/// @param msg Buffer where the message will be stored.
+/// @param len Length of the buffer "msg".
+/// @param ts Where the receive time will be stored (CLOCK_REALTIME). Zero if
+///  the data came without a timestamp. In TCP, the time of the last segment
+///  read.
+/// @param flags See "man recvmsg" ("0" by default).
+/// @return The amount of bytes received. "0" if the connection was closed
+///  correctly from the other end, or "-1" on error.
+int Socket::read_timestamped(void* msg, int len, struct timespec* ts, int flags) {
+    char control[256];
+    struct iovec iov = {msg, (size_t) len};
+    struct msghdr hdr;
+    struct cmsghdr* cmsg;
+    int bytes_read;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    memset(ts, 0, sizeof(struct timespec));
+    if ( (bytes_read = recvmsg(this->sockfd, &hdr, flags) ) == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror(ERROR("recvmsg in Socket::read_timestamped"));
+        }
+        return -1;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            *ts = ((struct scm_timestamping*) CMSG_DATA(cmsg))->ts[0];
+        }
+    }
+    return bytes_read;
+}
+
+/// @brief Writes several buffers to the socket with a single system call, as
+///  if they were one.
+/// @param iov Buffers to send, in order. The array is not modified.
+/// @param iovcnt Amount of buffers in "iov".
+/// @param flags See "man sendmsg" ("0" by default).
+/// @return Amount of bytes sent, or "-1" on error. Like Socket::write(), it
+///  keeps sending after a partial write, from the first byte not sent.
+int Socket::writev(const struct iovec* iov, int iovcnt, int flags) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec*) iov;
+    msg.msg_iovlen = iovcnt;
+    return this->write_msg(&msg, flags);
+}
+
+/// @brief Reads from the socket into several buffers, filling them in order,
+///  with a single system call.
+/// @param iov Buffers where the message will be stored.
+/// @param iovcnt Amount of buffers in "iov".
+/// @param flags See "man recvmsg" ("0" by default). With "MSG_WAITALL", it
+///  blocks until every buffer is full.
+/// @return The amount of bytes received. "0" if the connection was closed
+///  correctly from the other end, or "-1" on error.
+int Socket::readv(const struct iovec* iov, int iovcnt, int flags) {
+    struct msghdr msg;
+    int bytes_read;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec*) iov;
+    msg.msg_iovlen = iovcnt;
+    bytes_read = recvmsg(this->sockfd, &msg, flags);
+    if (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror(ERROR("recvmsg in Socket::readv"));
+    }
+    return bytes_read;
+}
+
+/// @brief Sends a message with "sendmsg()". After a partial write, the rest
+///  of the buffers are sent from the first byte not sent, without the
+///  destination and the control data, which went with the first part.
+/// @param msg Message to send. Neither the message nor its buffers are
+///  modified.
+/// @param flags See "man sendmsg" ("0" by default).
+/// @return Amount of bytes sent, or "-1" on error. In non-blocking mode, it
+///  returns the amount of bytes sent before the socket buffer filled up, or
+///  "-1" with errno "EAGAIN" if nothing could be sent.
+int Socket::write_msg(const struct msghdr* msg, int flags) {
+    std::vector<struct iovec> iov(msg->msg_iov, msg->msg_iov + msg->msg_iovlen);
+    struct msghdr part = *msg;
+    size_t first = 0;
+    int bytes_sent = 0;
+    int aux;
+    while (first < iov.size() && iov[first].iov_len == 0) {
+        first++;
+    }
+    while (first < iov.size()) {
+        part.msg_iov = &iov[first];
+        part.msg_iovlen = (iov.size() - first > IOV_MAX) ? IOV_MAX : iov.size() - first;
+        // Don't generate SIGPIPE, return with -1 if peer was closed
+        if ( (aux = sendmsg(this->sockfd, &part, flags | MSG_NOSIGNAL) ) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return (bytes_sent > 0) ? bytes_sent : -1;
+            }
+            perror(ERROR("sendmsg in Socket::write_msg"));
+            return -1;
+        }
+        bytes_sent += aux;
+        part.msg_name = NULL;
+        part.msg_namelen = 0;
+        part.msg_control = NULL;
+        part.msg_controllen = 0;
+        // Skip the buffers already sent, and move into the one sent partially.
+        while (first < iov.size() && (size_t) aux >= iov[first].iov_len) {
+            aux -= iov[first].iov_len;
+            first++;
+        }
+        if (first < iov.size()) {
+            iov[first].iov_base = (char*) iov[first].iov_base + aux;
+            iov[first].iov_len -= aux;
+        }
+    }
+    return bytes_sent;
+}
+
+/// @brief Sends "len" bytes of a file, starting at "offset", with
+///  "sendfile()", so they are never copied to user memory. The file offset of
+///  "fd" is not modified.
+/// @param fd File descriptor of a file that supports "mmap()", like a regular
+///  file.
+/// @param offset Position of the first byte to send.
+/// @param len Amount of bytes to send.
+/// @return Amount of bytes sent, which is less than "len" if the file ended
+///  first, or "-1" on error. In non-blocking mode, it returns the amount of
+///  bytes sent before the socket buffer filled up, or "-1" with errno "EAGAIN"
+///  if nothing could be sent. Continue from "offset" plus the bytes sent.
+ssize_t Socket::send_file(int fd, off_t offset, size_t len) {
+    ssize_t bytes_sent = 0;
+    ssize_t aux;
+    while ((size_t) bytes_sent < len) {
+        if ( (aux = sendfile(this->sockfd, fd, &offset, len - bytes_sent) ) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return (bytes_sent > 0) ? bytes_sent : -1;
+            }
+            perror(ERROR("sendfile in Socket::send_file"));
+            return -1;
+        }
+        if (aux == 0) {
+            // End of file.
+            break;
+        }
+        bytes_sent += aux;
+    }
+    return bytes_sent;
+}
+
+/// @brief Sends several messages with a single system call. Meant for
+///  datagram sockets, where each message is a datagram.
+/// @param msgs Messages to send. For a socket that is not connected, the
+///  destination of each message goes in "msg_hdr.msg_name". On return,
+///  "msg_len" holds the amount of bytes sent of each message.
+/// @param vlen Amount of messages in "msgs".
+/// @param flags See "man sendmmsg" ("0" by default).
+/// @return Amount of messages sent, or "-1" on error. In non-blocking mode,
+///  it returns the messages sent before the socket buffer filled up, or "-1"
+///  with errno "EAGAIN" if none could be sent.
+int Socket::write_batch(struct mmsghdr* msgs, int vlen, int flags) {
+    int msgs_sent = 0;
+    int aux;
+    do {
+        if ( (aux = sendmmsg(this->sockfd, msgs + msgs_sent, vlen - msgs_sent, flags | MSG_NOSIGNAL) ) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                msgs_sent = (msgs_sent > 0) ? msgs_sent : -1;
+                break;
+            }
+            perror(ERROR("sendmmsg in Socket::write_batch"));
+            msgs_sent = (msgs_sent > 0) ? msgs_sent : -1;
+            break;
+        }
+        msgs_sent += aux;
+    }while (msgs_sent < vlen);
+    return msgs_sent;
+}
+
+/// @brief Receives several messages with a single system call. Meant for
+///  datagram sockets, where each message is a datagram.
+/// @param msgs Where the messages will be stored. Before the call, set the
+///  buffers of each one in "msg_hdr.msg_iov", and "msg_hdr.msg_namelen" to
+///  the size of "msg_hdr.msg_name" to get the sender. On return, "msg_len"
+///  holds the amount of bytes received in each message.
+/// @param vlen Amount of messages in "msgs".
+/// @param flags See "man recvmmsg" ("0" by default). With "MSG_WAITFORONE",
+///  it blocks only until the first message arrives.
+/// @return Amount of messages received, or "-1" on error. In non-blocking
+///  mode, "-1" with errno "EAGAIN" means there is nothing to read yet.
+int Socket::read_batch(struct mmsghdr* msgs, int vlen, int flags) {
+    int msgs_read = recvmmsg(this->sockfd, msgs, vlen, flags, NULL);
+    if (msgs_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror(ERROR("recvmmsg in Socket::read_batch"));
+    }
+    return msgs_read;
+}
+
 /******************************************************************************
  *  Setters and getters
 ******************************************************************************/
 
-/// @brief Copy the IP of the connected peer.
-/// @param ip Where the IP will be copied.
+/// @brief Sets the socket in non-blocking mode. "read()" and "write()" will
+///  return "-1" with errno "EAGAIN" instead of blocking.
+/// @param nonblocking "true" to set non-blocking mode, "false" to go back to
+///  blocking mode ("true" by default).
+/// @return "0" on success, "-1" on error.
+int Socket::set_nonblocking(bool nonblocking) {
+    int flags;
+    if ( (flags = fcntl(this->sockfd, F_GETFL) ) == -1) {
+        perror(ERROR("fcntl in Socket::set_nonblocking"));
+        return -1;
+    }
+    flags = (nonblocking) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (fcntl(this->sockfd, F_SETFL, flags) == -1) {
+        perror(ERROR("fcntl in Socket::set_nonblocking"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Enables zero-copy sends ("MSG_ZEROCOPY") in Socket::write(). The
+///  kernel sends straight from the caller's buffer, so it can't be modified
+///  until the send completes. Each zero-copy send gets an ID, counting from
+///  "0"; after a write, the IDs below get_zerocopy_id() are in flight, and
+///  poll_completions() reports when they complete. Pinning the pages only
+///  pays off for large buffers, so shorter writes are still copied.
+/// @param enable "true" to enable zero-copy sends ("true" by default).
+/// @param min_len Writes shorter than this are copied ("16384" by default).
+/// @return "0" on success, "-1" on error.
+int Socket::set_zerocopy(bool enable, int min_len) {
+    int value = enable ? 1 : 0;
+    if (enable && setsockopt(this->sockfd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) == -1) {
+        perror(ERROR("setsockopt in Socket::set_zerocopy"));
+        return -1;
+    }
+    this->zerocopy = enable;
+    this->zerocopy_min = min_len;
+    return 0;
+}
+
+/// @brief Reads the completions of zero-copy sends, and the send timestamps
+///  of set_timestamping(), from the socket error queue, without blocking
+///  unless "timeout" is given.
+/// @param on_complete If not NULL, called for each completion with the
+///  range of IDs completed, from "first" to "last" both included. "copied" is
+///  "true" if the kernel had to copy the data anyway, as on loopback. After
+///  the call, the buffers of those sends can be reused.
+/// @param args Passed to "on_complete" and "on_timestamp".
+/// @param timeout Milliseconds to wait for a completion if there is none
+///  yet. "0" returns right away ("0" by default), "-1" waits forever.
+/// @param on_timestamp If not NULL, called for each send timestamp, with the
+///  time in "ts" (CLOCK_REALTIME). "type" is "SCM_TSTAMP_SND" when the data
+///  left the stack for the device, and "SCM_TSTAMP_ACK" when the peer
+///  acknowledged all of it, in TCP. "id" identifies the send: in TCP, the
+///  amount of bytes written since timestamping was enabled up to the last one
+///  of the send, minus one; otherwise, the number of the send, from "0".
+/// @return Amount of sends completed plus timestamps read, or "-1" on error.
+int Socket::poll_completions(void (*on_complete)(uint32_t first, uint32_t last, bool copied, void* args),
+    void* args, int timeout, void (*on_timestamp)(uint32_t id, int type, const struct timespec* ts, void* args)) {
+    char control[256];
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    struct sock_extended_err* err;
+    struct scm_timestamping* stamps;
+    struct timespec ts;
+    struct pollfd pfd;
+    int completed = 0;
+    while (true) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(this->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror(ERROR("recvmsg in Socket::poll_completions"));
+                return -1;
+            }
+            if (completed > 0 || timeout == 0) {
+                break;
+            }
+            // Error queue events are always reported as "POLLERR".
+            pfd.fd = this->sockfd;
+            pfd.events = 0;
+            if (poll(&pfd, 1, timeout) <= 0) {
+                break;
+            }
+            timeout = 0;
+            continue;
+        }
+        memset(&ts, 0, sizeof(ts));
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            // The time comes before the error that says what it belongs to.
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                stamps = (struct scm_timestamping*) CMSG_DATA(cmsg);
+                ts = stamps->ts[0];
+                continue;
+            }
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            err = (struct sock_extended_err*) CMSG_DATA(cmsg);
+            if (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && err->ee_errno == ENOMSG) {
+                completed++;
+                if (on_timestamp != NULL) {
+                    on_timestamp(err->ee_data, err->ee_info, &ts, args);
+                }
+                continue;
+            }
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+                continue;
+            }
+            completed += err->ee_data - err->ee_info + 1;
+            this->zerocopy_pending -= err->ee_data - err->ee_info + 1;
+            if (on_complete != NULL) {
+                on_complete(err->ee_info, err->ee_data, err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED, args);
+            }
+        }
+    }
+    return completed;
+}
+
+/// @brief Return the ID the next zero-copy send will get.
+uint32_t Socket::get_zerocopy_id(void) const {
+    return this->zerocopy_next;
+}
+
+/// @brief Return the amount of zero-copy sends not completed yet.
+uint32_t Socket::get_zerocopy_pending(void) const {
+    return this->zerocopy_pending;
+}
+
+/// @brief Sets a group of options that trade latency against throughput.
+///  Options that only exist in TCP are skipped for other sockets. Buffer sizes
+///  only scale the TCP window when set before connecting, so pass the profile
+///  to the constructor instead when possible; servers pass it to their
+///  listening socket, and the sockets they accept inherit it.
+/// @param profile See SocketProfile. "SOCKET_PROFILE_DEFAULT" turns off the
+///  options of the others, except the buffer sizes.
+/// @param buffer_size Size of the send and receive buffers, in bytes. "0" uses
+///  the size of the profile: "65536" for "SOCKET_PROFILE_LATENCY", "4194304"
+///  for "SOCKET_PROFILE_THROUGHPUT", and the kernel's for the default one. The
+///  kernel limits it to "net.core.rmem_max" and "net.core.wmem_max".
+/// @return "0" on success, "-1" if any option couldn't be set. The rest are
+///  set anyway. Raising "SO_BUSY_POLL" needs "CAP_NET_ADMIN", so without it
+///  "SO_BUSY_POLL" is left as it was.
+int Socket::set_profile(SocketProfile profile, int buffer_size) {
+    bool tcp = this->is_tcp();
+    bool latency = (profile == SOCKET_PROFILE_LATENCY);
+    int nodelay = latency ? 1 : 0;
+    int busy_poll = latency ? 50 : 0;
+    int status = 0;
+    if (buffer_size == 0) {
+        buffer_size = latency ? 65536 : (profile == SOCKET_PROFILE_THROUGHPUT) ? 4194304 : 0;
+    }
+    if (buffer_size > 0 && (setsockopt(this->sockfd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)) == -1 ||
+            setsockopt(this->sockfd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)) == -1)) {
+        perror(ERROR("setsockopt in Socket::set_profile. Buffer sizes"));
+        status = -1;
+    }
+    if (setsockopt(this->sockfd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) == -1 &&
+            errno != EPERM) {
+        perror(WARNING("setsockopt in Socket::set_profile. SO_BUSY_POLL"));
+    }
+    if (tcp) {
+        if (setsockopt(this->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1) {
+            perror(ERROR("setsockopt in Socket::set_profile. TCP_NODELAY"));
+            status = -1;
+        }
+        // Turning it off would delay ACKs, instead of leaving the kernel's mode.
+        if (latency && setsockopt(this->sockfd, IPPROTO_TCP, TCP_QUICKACK, &nodelay, sizeof(nodelay)) == -1) {
+            perror(ERROR("setsockopt in Socket::set_profile. TCP_QUICKACK"));
+            status = -1;
+        }
+        if (this->set_cork(profile == SOCKET_PROFILE_THROUGHPUT) == -1) {
+            status = -1;
+        }
+    }
+    this->profile = profile;
+    this->quickack = tcp && latency;
+    return status;
+}
+
+/// @brief Takes the profile of "listener" on a socket it accepted. The kernel
+///  copies the options of the listening socket to the accepted one, so only
+///  the flags kept by this object are copied, without any system call.
+void Socket::inherit_profile(const Socket& listener) {
+    this->profile = listener.profile;
+    this->quickack = listener.quickack;
+}
+
+/// @brief Spins in Socket::read() for up to "usec" microseconds, polling the
+///  socket without blocking, before blocking until data arrives. It saves the
+///  wake up of a blocked thread when the answer arrives soon, at the cost of
+///  a busy CPU. Unlike "SO_BUSY_POLL", it doesn't need support of the driver.
+/// @param usec Microseconds spinning, "0" to disable it.
+/// @return "0" on success, "-1" with errno "EINVAL" if "usec" is negative.
+int Socket::set_busy_poll(int usec) {
+    if (usec < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    this->busy_poll = usec;
+    return 0;
+}
+
+/// @brief Corks a TCP socket: only full segments are sent until it's uncorked,
+///  which sends the data left right away, or until 200ms have passed. Set by
+///  "SOCKET_PROFILE_THROUGHPUT".
+/// @param enable "true" to cork the socket, "false" to uncork it and flush it.
+/// @return "0" on success, "-1" on error.
+int Socket::set_cork(bool enable) {
+    int value = enable ? 1 : 0;
+    if (setsockopt(this->sockfd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == -1) {
+        perror(ERROR("setsockopt in Socket::set_cork"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Enables TCP Fast Open on a server socket, so clients with a cookie
+///  can send their first message in the SYN, see Socket::connect_fastopen().
+///  Must be called before "listen()". The server still needs Fast Open enabled
+///  in "net.ipv4.tcp_fastopen"; if it isn't, clients fall back to a regular
+///  handshake.
+/// @param qlen Most connections with data in the SYN waiting for the
+///  handshake to finish, which limits SYN floods with fake cookies ("16" by
+///  default). "0" disables it.
+/// @return "0" on success, "-1" on error, for example if the kernel doesn't
+///  support it.
+int Socket::set_fastopen(int qlen) {
+    if (setsockopt(this->sockfd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) == -1) {
+        perror(WARNING("setsockopt in Socket::set_fastopen"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Returns the queue length set with Socket::set_fastopen(), "0" if
+///  it's disabled.
+int Socket::get_fastopen(void) const {
+    int qlen = 0;
+    socklen_t optlen = sizeof(qlen);
+    if (getsockopt(this->sockfd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, &optlen) == -1) {
+        return 0;
+    }
+    return qlen;
+}
+
+/// @brief Enables software timestamps ("SO_TIMESTAMPING"). Received data gets
+///  the time the kernel got it, read with read_timestamped(). Sends get the
+///  time they left the stack and, in TCP, the time the peer acknowledged them,
+///  read with poll_completions().
+/// @param rx "true" to timestamp received data ("true" by default).
+/// @param tx "true" to timestamp sends ("true" by default). Their IDs count
+///  from the moment it's enabled.
+///  The kernel turns receive timestamps on asynchronously, so data arriving
+///  right after the first socket enables them might come without one.
+/// @return "0" on success, "-1" on error. "false" in both disables it.
+int Socket::set_timestamping(bool rx, bool tx) {
+    int flags = 0;
+    if (rx) {
+        flags |= SOF_TIMESTAMPING_RX_SOFTWARE;
+    }
+    if (tx) {
+        // Only the time is queued, not a copy of the packet.
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        if (this->is_tcp()) {
+            flags |= SOF_TIMESTAMPING_TX_ACK;
+        }
+    }
+    if (flags != 0) {
+        flags |= SOF_TIMESTAMPING_SOFTWARE;
+    }
+    if (setsockopt(this->sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1) {
+        perror(ERROR("setsockopt in Socket::set_timestamping"));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Returns the profile set with Socket::set_profile().
+SocketProfile Socket::get_profile(void) const {
+    return this->profile;
+}
+
+/// @brief Returns the microseconds spinning in Socket::read(), or "0".
+int Socket::get_busy_poll(void) const {
+    return this->busy_poll;
+}
+
+/// @brief Copy the IP of the connected peer. For a server, its own IP.
+/// @param ip Where the IP will be copied. Empty if there's no peer, or it has
+///  no IP.
 void Socket::get_peer_ip(char* ip) const {
-    strcpy(ip, this->peer_ip);
+    ip[0] = '\0';
+    if (this->peer_addrlen > 0) {
+        Socket::get_ip_from_sockaddr(ip, (const struct sockaddr*) &this->peer_addr);
+    }
 }
 
-/// @brief Return peer's port.
+/// @brief Return peer's port, or "0" if it has none.
 int Socket::get_peer_port(void) const {
-    return this->peer_port;
+    if (this->peer_addrlen == 0) {
+        return 0;
+    }
+    return Socket::get_port_from_sockaddr((const struct sockaddr*) &this->peer_addr);
 }
 
-/// @brief Copy your own IP.
-/// @param ip Where the IP will be copied.
+/// @brief Copy your own IP. It's asked to the kernel, so the socket must be
+///  open.
+/// @param ip Where the IP will be copied. Empty on error.
 void Socket::get_my_ip(char* ip) const {
-    strcpy(ip, this->my_ip);
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    ip[0] = '\0';
+    if (this->get_my_addr(&addr, &addrlen) == 0) {
+        Socket::get_ip_from_sockaddr(ip, (struct sockaddr*) &addr);
+    }
 }
 
-/// @brief Return your own port.
+/// @brief Copy the path of a Unix domain socket, with a leading '@' for the
+///  abstract namespace. Empty for other families. An accepted socket has the
+///  path of its server.
+/// @param path Where the path will be copied. Its size must be at least
+///  "UNIX_ADDRSTRLEN".
+void Socket::get_path(char* path) const {
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    path[0] = '\0';
+    if (this->peer_addrlen == 0 || this->peer_addr.ss_family != AF_UNIX) {
+        return;
+    }
+    Socket::get_path_from_sockaddr(path, (const struct sockaddr*) &this->peer_addr, this->peer_addrlen);
+    // Clients of a server are usually unnamed, so the path is the own one.
+    if (path[0] == '\0' && this->get_my_addr(&addr, &addrlen) == 0) {
+        Socket::get_path_from_sockaddr(path, (struct sockaddr*) &addr, addrlen);
+    }
+}
+
+/// @brief Return your own port, or "-1" on error. Like get_my_ip(), the
+///  socket must be open.
 int Socket::get_my_port() const {
-    return this->my_port;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    if (this->get_my_addr(&addr, &addrlen) == -1) {
+        return -1;
+    }
+    return Socket::get_port_from_sockaddr((struct sockaddr*) &addr);
 }
 
 /// @brief Return the socket file descriptor.
@@ -256,6 +1068,14 @@ Socket& Socket::operator<< (char a) {
     return *this;
 }
 
+/// @brief Sends every field of "a" with a single Socket::writev().
+Socket& Socket::operator<< (SocketMsg& a) {
+    if (a.get_len() > 0 && this->writev(a.get_iov(), a.get_iovcnt(), 0) != (int) a.get_len()) {
+        throw(std::runtime_error(""));
+    }
+    return *this;
+}
+
 Socket& Socket::operator>> (int &a) {
     if (this->read((void*)&a, sizeof(int), 0) <= 0) {
         throw(std::runtime_error(""));
@@ -270,6 +1090,143 @@ Socket& Socket::operator>> (char &a) {
     return *this;
 }
 
+/******************************************************************************
+ * SocketMsg
+******************************************************************************/
+
+/// @brief Adds a buffer to the message, without copying it.
+/// @param data Buffer to send. Must stay valid until the message is sent.
+/// @param len Length of "data" in bytes.
+SocketMsg& SocketMsg::add(const void* data, size_t len) {
+    Field field = {data, 0, len};
+    this->fields.push_back(field);
+    return *this;
+}
+
+/// @brief Removes every field, so the message can be reused.
+void SocketMsg::clear(void) {
+    this->fields.clear();
+    this->values.clear();
+}
+
+/// @brief Return the length of the whole message in bytes.
+size_t SocketMsg::get_len(void) const {
+    size_t len = 0;
+    for (size_t i = 0; i < this->fields.size(); i++) {
+        len += this->fields[i].len;
+    }
+    return len;
+}
+
+/// @brief Return the fields as an array of "get_iovcnt()" buffers, valid
+///  until the message is modified.
+struct iovec* SocketMsg::get_iov(void) {
+    this->iov.resize(this->fields.size());
+    for (size_t i = 0; i < this->fields.size(); i++) {
+        this->iov[i].iov_base = (this->fields[i].data != NULL) ?
+            (void*) this->fields[i].data : (void*) &this->values[this->fields[i].offset];
+        this->iov[i].iov_len = this->fields[i].len;
+    }
+    return this->iov.data();
+}
+
+/// @brief Return the amount of fields.
+int SocketMsg::get_iovcnt(void) const {
+    return this->fields.size();
+}
+
+/// @brief Adds the string, with its null terminator, as Socket::operator<<.
+///  The string is not copied.
+SocketMsg& SocketMsg::operator<< (const char* a) {
+    return this->add(a, strlen(a) + 1);
+}
+
+SocketMsg& SocketMsg::operator<< (int a) {
+    return this->add_value(&a, sizeof(int));
+}
+
+SocketMsg& SocketMsg::operator<< (char a) {
+    return this->add_value(&a, sizeof(char));
+}
+
+/// @brief Copies a small value into the message. The iovecs are built when
+///  sending, since "values" may be reallocated.
+SocketMsg& SocketMsg::add_value(const void* data, size_t len) {
+    Field field = {NULL, this->values.size(), len};
+    this->values.insert(this->values.end(), (const char*) data, (const char*) data + len);
+    this->fields.push_back(field);
+    return *this;
+}
+
+/******************************************************************************
+ * Relay
+******************************************************************************/
+
+/// @brief Creates the pipe used to relay from "from" to "to".
+/// @param from Socket to read from.
+/// @param to Socket to write to.
+/// @param pipe_size Capacity of the pipe, the most moved with each
+///  transfer(). The kernel may round it up.
+/// @return Might throw std::runtime_error on error.
+Relay::Relay(Socket& from, Socket& to, size_t pipe_size): from(from), to(to), pending(0) {
+    int size;
+    if (pipe2(this->pipefd, O_NONBLOCK | O_CLOEXEC) == -1) {
+        perror(ERROR("pipe2 in Relay::Relay"));
+        throw(std::runtime_error("pipe2"));
+    }
+    if ( (size = fcntl(this->pipefd[1], F_SETPIPE_SZ, (int) pipe_size) ) == -1) {
+        perror(WARNING("fcntl in Relay::Relay. Using the default pipe size"));
+        size = fcntl(this->pipefd[1], F_GETPIPE_SZ);
+    }
+    this->pipe_size = size;
+}
+
+/// @brief Closes the pipe. Bytes still in the pipe are lost.
+Relay::~Relay() {
+    ::close(this->pipefd[0]);
+    ::close(this->pipefd[1]);
+}
+
+/// @brief Reads once from "from" into the pipe, and moves everything in the
+///  pipe to "to". If "to" couldn't take every byte last time, those are sent
+///  first, before reading again.
+/// @return Amount of bytes moved to "to", "0" if "from" was closed and the
+///  pipe is empty, or "-1" on error. When a socket is in non-blocking mode,
+///  "-1" with errno "EAGAIN" means nothing could be moved yet.
+ssize_t Relay::transfer(void) {
+    ssize_t bytes_sent = 0;
+    ssize_t aux;
+    if (this->pending == 0) {
+        aux = splice(this->from.get_sockfd(), NULL, this->pipefd[1], NULL, this->pipe_size,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (aux <= 0) {
+            if (aux == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror(ERROR("splice in Relay::transfer"));
+            }
+            return aux;
+        }
+        this->pending = aux;
+    }
+    while (this->pending > 0) {
+        if ( (aux = splice(this->pipefd[0], NULL, this->to.get_sockfd(), NULL, this->pending,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK) ) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return (bytes_sent > 0) ? bytes_sent : -1;
+            }
+            perror(ERROR("splice in Relay::transfer"));
+            return -1;
+        }
+        this->pending -= aux;
+        bytes_sent += aux;
+    }
+    return bytes_sent;
+}
+
+/// @brief Return the amount of bytes read from "from" but not sent to "to".
+size_t Relay::get_pending(void) const {
+    return this->pending;
+}
+
 /******************************************************************************
  * Private methods
 ******************************************************************************/
@@ -277,18 +1234,23 @@ Socket& Socket::operator>> (char &a) {
 /// @brief Gets the Ip value from a sockaddr. Used after an "accept()" call to
 ///  get the peer's IP, or after a "getaddrinfo() to know your own."
 /// @param ip Place where the IP will be stored. It's size must be large enough
-///  to store an IPv4 (INET_ADDRSTRLEN) or and Ipv6 (INET6_ADDRSTRLEN).
+///  to store an IPv4 (INET_ADDRSTRLEN) or and Ipv6 (INET6_ADDRSTRLEN). Empty
+///  for other families, see Socket::get_path().
 /// @param sa struct sockaddr, returned by "accept()" or "getaddrinfo()".
 /// @return "0" on success, "-1" on error.
-int Socket::get_ip_from_sockaddr(char* ip, struct sockaddr* sa) {
+int Socket::get_ip_from_sockaddr(char* ip, const struct sockaddr* sa) {
     if (sa->sa_family == AF_INET) {
-        if (inet_ntop(sa->sa_family, &(((struct sockaddr_in*) sa)->sin_addr), ip, INET_ADDRSTRLEN) == NULL) {
+        if (inet_ntop(sa->sa_family, &(((const struct sockaddr_in*) sa)->sin_addr), ip, INET_ADDRSTRLEN) == NULL) {
             perror(ERROR("inet_ntop in Socket::get_ip_from_sockaddr"));
             return -1;
         }
-    } else if (inet_ntop(sa->sa_family, &(((struct sockaddr_in6*)sa)->sin6_addr), ip, INET6_ADDRSTRLEN) == NULL) {
+    } else if (sa->sa_family == AF_INET6) {
+        if (inet_ntop(sa->sa_family, &(((const struct sockaddr_in6*) sa)->sin6_addr), ip, INET6_ADDRSTRLEN) == NULL) {
             perror(ERROR("inet_ntop in Socket::get_ip_from_sockaddr"));
             return -1;
+        }
+    } else {
+        ip[0] = '\0';
     }
     return 0;
 }
@@ -296,40 +1258,181 @@ int Socket::get_ip_from_sockaddr(char* ip, struct sockaddr* sa) {
 /// @brief Returns the port number. Used after an "accept()" cal to get the
 ///  peer's port, or after a "getaddrinfo()" to know your own.
 /// @param sa struct sockaddr, as gotten from "accept()" or "getaddrinfo()".
-/// @return Port number. Always succeeds.
-int Socket::get_port_from_sockaddr(struct sockaddr* sa) {
+/// @return Port number, "0" for families without ports. Always succeeds.
+int Socket::get_port_from_sockaddr(const struct sockaddr* sa) {
     if (sa->sa_family == AF_INET) {
-        return (int) ntohs(((struct sockaddr_in*)sa)->sin_port);
-    } else {
-        return (int) ntohs(((struct sockaddr_in6*)sa)->sin6_port);
+        return (int) ntohs(((const struct sockaddr_in*)sa)->sin_port);
+    } else if (sa->sa_family == AF_INET6) {
+        return (int) ntohs(((const struct sockaddr_in6*)sa)->sin6_port);
     }
+    return 0;
 }
 
-/// @brief Get your own IP address after a successful call to "connect()".
-/// @param sockfd Socket file descriptor.
-/// @param ip Where the IP will be stored. Its size should be "INET_ADDRSTRLEN"
-///  for Ipv4, or "INET6_ADDRSTRLEN" for Ipv6.
+/// @brief Gets your own address with "getsockname()".
+/// @param addr Where the address will be stored.
+/// @param addrlen Where the size of the address will be stored.
 /// @return "0" on success, "-1" on error.
-int Socket::get_ip_from_sockfd(int sockfd, char* ip) {
-    struct sockaddr_storage addr;
-    socklen_t addrlen = sizeof(addr);
-    if (getsockname(sockfd, (struct sockaddr*)&addr, &addrlen) != 0) {
-        perror(ERROR("getsockname in Socket::get_ip_from_sockfd"));
+int Socket::get_my_addr(struct sockaddr_storage* addr, socklen_t* addrlen) const {
+    *addrlen = sizeof(struct sockaddr_storage);
+    if (getsockname(this->sockfd, (struct sockaddr*) addr, addrlen) == -1) {
+        perror(ERROR("getsockname in Socket::get_my_addr"));
         return -1;
     }
-    this->get_ip_from_sockaddr(ip, (struct sockaddr*)&addr);
     return 0;
 }
 
-/// @brief Get your own port after a successful call to "connect()".
-/// @param sockfd Socket file descriptor.
-/// @return The port number, or "-1" on error.
-int Socket::get_port_from_sockfd(int sockfd) {
-    struct sockaddr_storage addr;
-    socklen_t addrlen = sizeof(addr);
-    if (getsockname(sockfd, (struct sockaddr*)&addr, &addrlen) != 0) {
-        perror(ERROR("getsockname in Socket::get_port_from_sockfd"));
+/// @brief Stores the address of the peer, formatted later by the getters.
+/// @param addr Address of the peer.
+/// @param addrlen Size of "addr".
+void Socket::set_peer_addr(const struct sockaddr* addr, socklen_t addrlen) {
+    this->peer_addrlen = std::min(addrlen, (socklen_t) sizeof(this->peer_addr));
+    memcpy(&this->peer_addr, addr, this->peer_addrlen);
+}
+
+/// @brief Gets the path of a Unix domain socket address, as given to the
+///  constructor: with a leading '@' for the abstract namespace, or empty if
+///  it's unnamed.
+/// @param path Where the path will be stored, of "UNIX_ADDRSTRLEN" bytes.
+/// @param sa Address of the socket.
+/// @param addrlen Size of "sa", which sets the length of abstract names.
+void Socket::get_path_from_sockaddr(char* path, const struct sockaddr* sa, socklen_t addrlen) {
+    const struct sockaddr_un* addr = (const struct sockaddr_un*) sa;
+    size_t len = (addrlen > offsetof(struct sockaddr_un, sun_path)) ? addrlen - offsetof(struct sockaddr_un, sun_path) : 0;
+    if (len == 0) {
+        path[0] = '\0';
+    } else if (addr->sun_path[0] == '\0') {
+        path[0] = '@';
+        memcpy(path + 1, addr->sun_path + 1, len - 1);
+        path[len] = '\0';
+    } else {
+        strncpy(path, addr->sun_path, len);
+        path[len] = '\0';
+    }
+}
+
+/// @brief Builds the address of a Unix domain socket.
+/// @param path Path of the socket, or a name starting with '@' for the
+///  abstract namespace.
+/// @param addr Where the address will be stored.
+/// @param addrlen Where the size of the address will be stored.
+/// @return "0" on success, "-1" with errno "ENAMETOOLONG" if the path is too
+///  long, or "EINVAL" if it's empty.
+int Socket::get_unix_addr(const char* path, struct sockaddr_un* addr, socklen_t* addrlen) {
+    size_t len = (path == NULL) ? 0 : strlen(path);
+    if (len == 0 || (path[0] == '@' && len == 1)) {
+        errno = EINVAL;
         return -1;
     }
-    return this->get_port_from_sockaddr((struct sockaddr*)&addr);
+    if (len >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (path[0] == '@') {
+        // Abstract names are not null terminated, their length is the limit.
+        memcpy(addr->sun_path + 1, path + 1, len - 1);
+        *addrlen = offsetof(struct sockaddr_un, sun_path) + len;
+    } else {
+        memcpy(addr->sun_path, path, len);
+        *addrlen = offsetof(struct sockaddr_un, sun_path) + len + 1;
+    }
+    return 0;
+}
+
+/// @brief Constructor for Unix domain sockets. A server binds to "path",
+///  removing the socket file left there by a previous run if nothing answers
+///  on it anymore, and removes it again when closed; a client connects to it.
+/// @return Might throw std::runtime_error on error. It fails with errno
+///  "EADDRINUSE" if a server is still running on "path".
+void Socket::init_unix(const char* path, int socktype, bool server) {
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    struct stat info;
+    int probe, error;
+    if (Socket::get_unix_addr(path, &addr, &addrlen) == -1) {
+        perror(ERROR("Invalid path in Socket::Socket"));
+        throw(std::runtime_error("Socket"));
+    }
+    if ( (this->sockfd = socket(AF_UNIX, socktype, 0) ) == -1) {
+        perror(ERROR("socket in Socket::Socket"));
+        throw(std::runtime_error("Socket"));
+    }
+    if (server) {
+        if (path[0] != '@' && stat(path, &info) == 0 && S_ISSOCK(info.st_mode) &&
+                (probe = socket(AF_UNIX, socktype, 0) ) != -1) {
+            // Only a stale file refuses connections. A live server keeps it,
+            // and bind() fails with "EADDRINUSE".
+            if (::connect(probe, (struct sockaddr*) &addr, addrlen) == -1 && errno == ECONNREFUSED) {
+                unlink(path);
+            }
+            ::close(probe);
+        }
+        if (bind(this->sockfd, (struct sockaddr*) &addr, addrlen) == -1) {
+            error = errno;
+            perror(ERROR("bind in Socket::Socket"));
+            ::close(this->sockfd);
+            errno = error;
+            throw(std::runtime_error("Socket"));
+        }
+        if (path[0] != '@') {
+            this->path_owner = getpid();
+        }
+    } else if (::connect(this->sockfd, (struct sockaddr*) &addr, addrlen) == -1) {
+        perror(ERROR("Couldn't connect to the socket"));
+        ::close(this->sockfd);
+        throw(std::runtime_error("Socket"));
+    }
+    this->set_peer_addr((struct sockaddr*) &addr, addrlen);
+}
+
+/// @brief Removes the socket file bound by this socket. Forked processes keep
+///  it, so it is only removed by the one that bound it.
+void Socket::remove_path(void) {
+    if (this->path_owner != 0 && this->path_owner == getpid()) {
+        unlink(((struct sockaddr_un*) &this->peer_addr)->sun_path);
+    }
+    this->path_owner = 0;
+}
+
+/// @brief Returns "true" if the socket uses TCP.
+bool Socket::is_tcp(void) {
+    int protocol = 0;
+    socklen_t optlen = sizeof(protocol);
+    if (getsockopt(this->sockfd, SOL_SOCKET, SO_PROTOCOL, &protocol, &optlen) == -1) {
+        return false;
+    }
+    return protocol == IPPROTO_TCP;
+}
+
+/// @brief Socket::read() with busy polling: "recv()" without blocking until
+///  something arrives or "busy_poll" microseconds have passed, then a regular
+///  "recv()". Same parameters and return value as Socket::read().
+int Socket::read_busy_poll(void* msg, int len, int flags) {
+    struct timespec now;
+    long long now_us, deadline;
+    int bytes_read, aux;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_us = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    deadline = now_us + this->busy_poll;
+    do {
+        bytes_read = recv(this->sockfd, msg, len, flags | MSG_DONTWAIT);
+        if (bytes_read != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        now_us = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    } while (now_us < deadline);
+    if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return recv(this->sockfd, msg, len, flags);
+    }
+    // "MSG_DONTWAIT" returns what was there, so wait for the rest.
+    if (bytes_read > 0 && bytes_read < len && (flags & MSG_WAITALL)) {
+        if ( (aux = recv(this->sockfd, (char*) msg + bytes_read, len - bytes_read, flags) ) == -1) {
+            return -1;
+        }
+        bytes_read += aux;
+    }
+    return bytes_read;
 }
+
@@ -0,0 +1,186 @@
+#include "socket_pool.h"
+
+/******************************************************************************
+ * Constructors and destructors
+******************************************************************************/
+
+/// @brief Creates an empty pool.
+/// @param max_idle Most idle connections kept per (ip, port, family). Extra
+///  connections are closed when released.
+/// @param max_total Most connections per (ip, port, family), idle or in use.
+/// @param idle_timeout Milliseconds an idle connection is kept.
+/// @param connect_timeout Deadline for new connections, in milliseconds.
+SocketPool::SocketPool(int max_idle, int max_total, int idle_timeout, int connect_timeout):
+    max_idle(max_idle), max_total(max_total), idle_timeout(idle_timeout), connect_timeout(connect_timeout) {}
+
+/// @brief Closes every idle connection. Connections still in use are not
+///  closed, and must be deleted by their users instead of released.
+SocketPool::~SocketPool() {
+    std::map<std::string, Bucket>::iterator it;
+    for (it = this->buckets.begin(); it != this->buckets.end(); it++) {
+        for (size_t i = 0; i < it->second.idle.size(); i++) {
+            delete it->second.idle[i].socket;
+        }
+    }
+}
+
+/******************************************************************************
+ * Checkout and checkin
+******************************************************************************/
+
+/// @brief Gets a connected socket. The most recently used idle connection
+///  is reused, as long as it's still open; otherwise, a new one is made with
+///  Socket::connect(). Give it back with release() when the request is done.
+/// @param ip IP address or host name of the server, or NULL for the local host.
+/// @param port Port number as a string, or any protocol defined in "/etc/services".
+/// @param family AF_INET, AF_INET6 or AF_UNSPEC (default).
+/// @return The socket, or NULL on error. NULL with errno "EAGAIN" if there
+///  are already "max_total" connections in use to the server.
+Socket* SocketPool::acquire(const char* ip, const char* port, int family) {
+    std::string key = SocketPool::get_key(ip, port, family);
+    Socket* socket = NULL;
+    Bucket* bucket;
+
+    this->mutex.lock();
+    bucket = &this->buckets[key];
+    this->evict_bucket(*bucket, SocketPool::now());
+    while (socket == NULL && !bucket->idle.empty()) {
+        socket = bucket->idle.back().socket;
+        bucket->idle.pop_back();
+        if (!SocketPool::is_alive(socket)) {
+            delete socket;
+            socket = NULL;
+            bucket->total--;
+        }
+    }
+    if (socket == NULL) {
+        if (bucket->total >= this->max_total) {
+            this->mutex.unlock();
+            errno = EAGAIN;
+            return NULL;
+        }
+        // Reserve the place, and connect without holding the lock.
+        bucket->total++;
+        this->mutex.unlock();
+        socket = new Socket();
+        if (socket->connect(ip, port, this->connect_timeout, family) == -1) {
+            delete socket;
+            this->mutex.lock();
+            this->buckets[key].total--;
+            this->mutex.unlock();
+            return NULL;
+        }
+        this->mutex.lock();
+    }
+    this->in_use[socket] = key;
+    this->mutex.unlock();
+    return socket;
+}
+
+/// @brief Gives back a socket from acquire().
+/// @param socket Socket returned by acquire().
+/// @param reusable "false" if the connection must not be reused, for example
+///  after an error or with a response not fully read ("true" by default).
+void SocketPool::release(Socket* socket, bool reusable) {
+    std::map<Socket*, std::string>::iterator it;
+    Bucket* bucket;
+    Idle idle;
+
+    this->mutex.lock();
+    if ( (it = this->in_use.find(socket)) == this->in_use.end()) {
+        this->mutex.unlock();
+        fprintf(stderr, WARNING("Socket not from this pool in SocketPool::release\n"));
+        return;
+    }
+    bucket = &this->buckets[it->second];
+    this->in_use.erase(it);
+    if (!reusable || (int) bucket->idle.size() >= this->max_idle || socket->get_sockfd() == -1) {
+        bucket->total--;
+        this->mutex.unlock();
+        delete socket;
+        return;
+    }
+    idle.socket = socket;
+    idle.since = SocketPool::now();
+    bucket->idle.push_back(idle);
+    this->mutex.unlock();
+}
+
+/// @brief Closes the idle connections not used for "idle_timeout"
+///  milliseconds. It's also done on each acquire(), for that server.
+/// @return Amount of connections closed.
+int SocketPool::evict(void) {
+    std::map<std::string, Bucket>::iterator it;
+    long long now = SocketPool::now();
+    int evicted = 0;
+    this->mutex.lock();
+    for (it = this->buckets.begin(); it != this->buckets.end(); it++) {
+        evicted += this->evict_bucket(it->second, now);
+    }
+    this->mutex.unlock();
+    return evicted;
+}
+
+/******************************************************************************
+ *  Getters
+******************************************************************************/
+
+/// @brief Return the amount of idle connections to a server.
+int SocketPool::get_idle(const char* ip, const char* port, int family) {
+    int idle;
+    this->mutex.lock();
+    idle = this->buckets[SocketPool::get_key(ip, port, family)].idle.size();
+    this->mutex.unlock();
+    return idle;
+}
+
+/// @brief Return the amount of connections to a server, idle or in use.
+int SocketPool::get_total(const char* ip, const char* port, int family) {
+    int total;
+    this->mutex.lock();
+    total = this->buckets[SocketPool::get_key(ip, port, family)].total;
+    this->mutex.unlock();
+    return total;
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+std::string SocketPool::get_key(const char* ip, const char* port, int family) {
+    char family_str[16];
+    snprintf(family_str, sizeof(family_str), "|%d", family);
+    // A NULL ip is not the same as an empty one, as in Resolver.
+    return std::string((ip == NULL) ? "\n" : ip) + "|" + port + family_str;
+}
+
+/// @brief Returns CLOCK_MONOTONIC in milliseconds.
+long long SocketPool::now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/// @brief Checks, without blocking, that the peer didn't close an idle
+///  connection. Unexpected data, like a late response, also makes it unusable.
+bool SocketPool::is_alive(Socket* socket) {
+    char byte;
+    if (recv(socket->get_sockfd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT) == -1) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return false;
+}
+
+/// @brief Closes the expired connections of a bucket. The mutex must be held.
+/// @return Amount of connections closed.
+int SocketPool::evict_bucket(Bucket& bucket, long long now) {
+    int evicted = 0;
+    // The oldest ones are at the front.
+    while (!bucket.idle.empty() && now - bucket.idle.front().since >= this->idle_timeout) {
+        delete bucket.idle.front().socket;
+        bucket.idle.pop_front();
+        bucket.total--;
+        evicted++;
+    }
+    return evicted;
+}
@@ -0,0 +1,290 @@
+#include "socket_stream.h"
+
+/******************************************************************************
+ * Constructors and destructors
+******************************************************************************/
+
+/// @brief Creates a stream over a connected socket.
+/// @param socket Connected socket. It's not closed by the stream.
+/// @param read_size Size of the read buffer, the most read with one "recv()".
+/// @param write_size Size of the write buffer. Writes at least this long are
+///  sent right away.
+/// @param flush_threshold The write buffer is flushed as soon as it holds this
+///  amount of bytes. If "0", it's flushed only when full or with flush().
+/// @return Might throw std::runtime_error on error.
+SocketStream::SocketStream(Socket& socket, int read_size, int write_size, int flush_threshold):
+    socket(socket), read_start(0), read_end(0), write_len(0) {
+    if (read_size <= 0 || write_size <= 0) {
+        fprintf(stderr, ERROR("Buffer sizes must be positive in SocketStream::SocketStream\n"));
+        throw(std::runtime_error("SocketStream"));
+    }
+    this->read_buffer.resize(read_size);
+    this->write_buffer.resize(write_size);
+    this->flush_threshold = (flush_threshold <= 0 || flush_threshold > write_size) ? write_size : flush_threshold;
+}
+
+/// @brief Sends the bytes left in the write buffer, if the socket is open.
+SocketStream::~SocketStream() {
+    if (this->socket.get_sockfd() != -1) {
+        this->flush();
+    }
+}
+
+/******************************************************************************
+ * Read functions
+******************************************************************************/
+
+/// @brief Reads up to "len" bytes. Bytes in the read buffer are returned
+///  first; if it's empty, it's filled with a single "recv()".
+/// @param msg Buffer where the bytes will be stored.
+/// @param len Length of the buffer "msg".
+/// @return Amount of bytes read, "0" if the connection was closed by the
+///  peer, or "-1" on error.
+int SocketStream::read(void* msg, int len) {
+    int bytes_read;
+    if (this->read_start == this->read_end) {
+        if (len >= (int) this->read_buffer.size()) {
+            // Nothing to gain from the buffer.
+            return this->socket.read(msg, len);
+        }
+        if ( (bytes_read = this->fill()) <= 0) {
+            return bytes_read;
+        }
+    }
+    bytes_read = this->read_end - this->read_start;
+    bytes_read = (bytes_read < len) ? bytes_read : len;
+    memcpy(msg, &this->read_buffer[this->read_start], bytes_read);
+    this->read_start += bytes_read;
+    return bytes_read;
+}
+
+/// @brief Reads exactly "len" bytes, blocking until all of them arrive.
+/// @param msg Buffer where the bytes will be stored.
+/// @param len Amount of bytes to read.
+/// @return "len" on success, "0" if the connection was closed before "len"
+///  bytes arrived, or "-1" on error.
+int SocketStream::read_exact(void* msg, int len) {
+    int bytes_read = 0;
+    int aux;
+    while (bytes_read < len) {
+        if ( (aux = this->read((char*) msg + bytes_read, len - bytes_read) ) <= 0) {
+            return aux;
+        }
+        bytes_read += aux;
+    }
+    return bytes_read;
+}
+
+/// @brief Reads a frame ended by "delimiter". The delimiter is consumed, but
+///  not copied to "frame".
+/// @param delimiter Byte that ends every frame, like '\n'.
+/// @param frame Buffer where the frame will be stored.
+/// @param max_len Length of the buffer "frame".
+/// @return Length of the frame, which can be "0", or "-1" on error. "-1"
+///  with errno "ENOTCONN" if the connection was closed before a whole frame
+///  arrived, or "EMSGSIZE" if the frame doesn't fit in "frame" or in the read
+///  buffer.
+int SocketStream::read_until(char delimiter, void* frame, int max_len) {
+    char* end;
+    int searched = 0;
+    int frame_len, aux;
+    while (true) {
+        end = (char*) memchr(this->read_buffer.data() + this->read_start + searched, delimiter,
+            this->read_end - this->read_start - searched);
+        if (end != NULL) {
+            break;
+        }
+        searched = this->read_end - this->read_start;
+        if (searched > max_len || searched == (int) this->read_buffer.size()) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if ( (aux = this->fill()) <= 0) {
+            errno = (aux == 0) ? ENOTCONN : errno;
+            return -1;
+        }
+    }
+    frame_len = end - &this->read_buffer[this->read_start];
+    if (frame_len > max_len) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memcpy(frame, &this->read_buffer[this->read_start], frame_len);
+    this->read_start += frame_len + 1;
+    return frame_len;
+}
+
+/// @brief Reads a frame prefixed with its length, as sent by write_frame().
+/// @param frame Buffer where the frame will be stored.
+/// @param max_len Length of the buffer "frame".
+/// @return Length of the frame, which can be "0", or "-1" on error. "-1"
+///  with errno "ENOTCONN" if the connection was closed before a whole frame
+///  arrived, or "EMSGSIZE" if the frame doesn't fit in "frame". After
+///  "EMSGSIZE", the stream can't be used anymore.
+int SocketStream::read_frame(void* frame, int max_len) {
+    uint32_t frame_len;
+    int aux;
+    if ( (aux = this->read_exact(&frame_len, sizeof(frame_len)) ) <= 0) {
+        errno = (aux == 0) ? ENOTCONN : errno;
+        return -1;
+    }
+    frame_len = ntohl(frame_len);
+    if (frame_len > (uint32_t) max_len) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (frame_len > 0 && (aux = this->read_exact(frame, frame_len) ) <= 0) {
+        errno = (aux == 0) ? ENOTCONN : errno;
+        return -1;
+    }
+    return frame_len;
+}
+
+/******************************************************************************
+ * Write functions
+******************************************************************************/
+
+/// @brief Adds "len" bytes to the write buffer, which is flushed when it
+///  reaches the flush threshold. Writes that don't fit in the buffer are sent
+///  right away, after the bytes already buffered.
+/// @param msg Bytes to send.
+/// @param len Amount of bytes to send.
+/// @return "len" on success, or "-1" on error.
+int SocketStream::write(const void* msg, int len) {
+    if (this->write_len + len > (int) this->write_buffer.size()) {
+        if (this->flush() == -1) {
+            return -1;
+        }
+        if (len >= (int) this->write_buffer.size()) {
+            return (this->socket.write((void*) msg, len) == len) ? len : -1;
+        }
+    }
+    memcpy(&this->write_buffer[this->write_len], msg, len);
+    this->write_len += len;
+    if (this->write_len >= this->flush_threshold && this->flush() == -1) {
+        return -1;
+    }
+    return len;
+}
+
+/// @brief Writes "len" bytes and flushes the write buffer, so everything
+///  written up to now is sent.
+/// @return "len" on success, or "-1" on error.
+int SocketStream::write_all(const void* msg, int len) {
+    if (this->write(msg, len) == -1 || this->flush() == -1) {
+        return -1;
+    }
+    return len;
+}
+
+/// @brief Writes a frame prefixed with its length (4 bytes, network order),
+///  to be read with read_frame(). The frame is buffered like write().
+/// @return "len" on success, or "-1" on error.
+int SocketStream::write_frame(const void* frame, int len) {
+    uint32_t frame_len = htonl(len);
+    if (this->write(&frame_len, sizeof(frame_len)) == -1 || this->write(frame, len) == -1) {
+        return -1;
+    }
+    return len;
+}
+
+/// @brief Sends every byte in the write buffer. On a non-blocking socket, the
+///  bytes that couldn't be sent stay in the buffer.
+/// @return "0" on success, or "-1" on error. "-1" with errno "EAGAIN" if the
+///  socket buffer filled up before sending everything.
+int SocketStream::flush(void) {
+    int bytes_sent;
+    if (this->write_len == 0) {
+        return 0;
+    }
+    if ( (bytes_sent = this->socket.write(this->write_buffer.data(), this->write_len) ) == -1) {
+        return -1;
+    }
+    memmove(this->write_buffer.data(), &this->write_buffer[bytes_sent], this->write_len - bytes_sent);
+    this->write_len -= bytes_sent;
+    if (this->write_len > 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ *  Getters
+******************************************************************************/
+
+/// @brief Return the amount of bytes received but not read yet.
+int SocketStream::get_buffered(void) const {
+    return this->read_end - this->read_start;
+}
+
+/// @brief Return the amount of bytes written but not sent yet.
+int SocketStream::get_pending(void) const {
+    return this->write_len;
+}
+
+/// @brief Return the socket under the stream.
+Socket& SocketStream::get_socket(void) {
+    return this->socket;
+}
+
+/******************************************************************************
+ *  Overloaded operators
+******************************************************************************/
+
+SocketStream& SocketStream::operator<< (int a) {
+    if (this->write(&a, sizeof(int)) == -1) {
+        throw(std::runtime_error(""));
+    }
+    return *this;
+}
+
+SocketStream& SocketStream::operator<< (const char* a) {
+    if (this->write(a, strlen(a) + 1) == -1) {
+        throw(std::runtime_error(""));
+    }
+    return *this;
+}
+
+SocketStream& SocketStream::operator<< (char a) {
+    if (this->write(&a, sizeof(char)) == -1) {
+        throw(std::runtime_error(""));
+    }
+    return *this;
+}
+
+SocketStream& SocketStream::operator>> (int &a) {
+    if (this->read_exact(&a, sizeof(int)) <= 0) {
+        throw(std::runtime_error(""));
+    }
+    return *this;
+}
+
+SocketStream& SocketStream::operator>> (char &a) {
+    if (this->read_exact(&a, sizeof(char)) <= 0) {
+        throw(std::runtime_error(""));
+    }
+    return *this;
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Reads from the socket into the read buffer, with a single "recv()".
+///  The bytes not read yet are moved to the start of the buffer first.
+/// @return Amount of bytes received, "0" if the connection was closed by the
+///  peer, or "-1" on error.
+int SocketStream::fill(void) {
+    int bytes_read;
+    if (this->read_start > 0) {
+        memmove(this->read_buffer.data(), &this->read_buffer[this->read_start], this->read_end - this->read_start);
+        this->read_end -= this->read_start;
+        this->read_start = 0;
+    }
+    bytes_read = this->socket.read(&this->read_buffer[this->read_end], this->read_buffer.size() - this->read_end);
+    if (bytes_read > 0) {
+        this->read_end += bytes_read;
+    }
+    return bytes_read;
+}
@@ -0,0 +1,327 @@
+#include "uring.h"
+
+/******************************************************************************
+ * Constructors and initialization
+******************************************************************************/
+
+/// @brief Creates an io_uring instance and maps its queues.
+/// @param entries Minimum size of the submission queue. The kernel rounds it
+///  up to a power of two, and the completion queue is twice as big.
+/// @return Throws std::runtime_error on error, for example if the kernel
+///  doesn't support io_uring. See URing::is_supported().
+URing::URing(unsigned entries): sqe_tail(0) {
+    struct io_uring_params params;
+    char* sq;
+    char* cq;
+
+    memset(&params, 0, sizeof(params));
+    if ( (this->ring_fd = syscall(__NR_io_uring_setup, entries, &params) ) == -1) {
+        perror(ERROR("io_uring_setup in URing::URing"));
+        throw(std::runtime_error("io_uring_setup"));
+    }
+    this->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        // Both rings are in the same mapping.
+        this->sq_size = (this->cq_size > this->sq_size) ? this->cq_size : this->sq_size;
+        this->cq_size = this->sq_size;
+    }
+    this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->sq_ptr = mmap(NULL, this->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        this->ring_fd, IORING_OFF_SQ_RING);
+    if (this->sq_ptr == MAP_FAILED) {
+        perror(ERROR("mmap in URing::URing"));
+        ::close(this->ring_fd);
+        throw(std::runtime_error("mmap"));
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        this->cq_ptr = this->sq_ptr;
+    } else if ( (this->cq_ptr = mmap(NULL, this->cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_CQ_RING) ) == MAP_FAILED) {
+        perror(ERROR("mmap in URing::URing"));
+        munmap(this->sq_ptr, this->sq_size);
+        ::close(this->ring_fd);
+        throw(std::runtime_error("mmap"));
+    }
+    this->sqes = (struct io_uring_sqe*) mmap(NULL, this->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQES);
+    if (this->sqes == MAP_FAILED) {
+        perror(ERROR("mmap in URing::URing"));
+        if (this->cq_ptr != this->sq_ptr) {
+            munmap(this->cq_ptr, this->cq_size);
+        }
+        munmap(this->sq_ptr, this->sq_size);
+        ::close(this->ring_fd);
+        throw(std::runtime_error("mmap"));
+    }
+    sq = (char*) this->sq_ptr;
+    cq = (char*) this->cq_ptr;
+    this->sq_entries = params.sq_entries;
+    this->sq_head = (unsigned*) (sq + params.sq_off.head);
+    this->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    this->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    this->sq_array = (unsigned*) (sq + params.sq_off.array);
+    this->cq_head = (unsigned*) (cq + params.cq_off.head);
+    this->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    this->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    this->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    this->sqe_tail = *this->sq_tail;
+}
+
+/// @brief Unmaps the queues and closes the instance. Operations still in
+///  progress are cancelled.
+URing::~URing() {
+    munmap(this->sqes, this->sqes_size);
+    if (this->cq_ptr != this->sq_ptr) {
+        munmap(this->cq_ptr, this->cq_size);
+    }
+    munmap(this->sq_ptr, this->sq_size);
+    ::close(this->ring_fd);
+}
+
+/// @brief Checks if the kernel allows io_uring, and supports every operation
+///  used by this class.
+/// @return "true" if it can be used, "false" otherwise.
+bool URing::is_supported(void) {
+    static const int ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+        IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_POLL_ADD, IORING_OP_TIMEOUT,
+        IORING_OP_ASYNC_CANCEL};
+    struct io_uring_params params;
+    struct io_uring_probe* probe;
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    bool supported = true;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    if ( (fd = syscall(__NR_io_uring_setup, 2, &params) ) == -1) {
+        return false;
+    }
+    probe = (struct io_uring_probe*) calloc(1, probe_size);
+    if (probe == NULL || syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == -1) {
+        supported = false;
+    }
+    for (size_t i = 0; supported && i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            supported = false;
+        }
+    }
+    free(probe);
+    ::close(fd);
+    return supported;
+}
+
+/******************************************************************************
+ * Submission and completion
+******************************************************************************/
+
+/// @brief Sends every prepared operation to the kernel with a single system
+///  call, and optionally waits for completions.
+/// @param wait_nr Minimum number of completions to wait for ("0" by default).
+/// @return Number of operations submitted, or "-1" on error. "errno" is
+///  "EINTR" if the wait was interrupted by a signal.
+int URing::submit(unsigned wait_nr) {
+    unsigned to_submit;
+    int submitted;
+    __atomic_store_n(this->sq_tail, this->sqe_tail, __ATOMIC_RELEASE);
+    to_submit = this->sqe_tail - __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+    if ( (submitted = syscall(__NR_io_uring_enter, this->ring_fd, to_submit, wait_nr,
+            (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0) ) == -1) {
+        if (errno != EINTR) {
+            perror(ERROR("io_uring_enter in URing::submit"));
+        }
+        return -1;
+    }
+    return submitted;
+}
+
+/// @brief Returns the oldest completion not seen yet, or NULL if there are
+///  none. Call URing::seen() after using it.
+struct io_uring_cqe* URing::peek(void) {
+    unsigned head = *this->cq_head;
+    if (head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &this->cqes[head & *this->cq_mask];
+}
+
+/// @brief Releases the completion returned by URing::peek().
+void URing::seen(void) {
+    __atomic_store_n(this->cq_head, *this->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief Registers buffers in the kernel, to be used with prep_read_fixed()
+///  and prep_write_fixed() without mapping them on every operation.
+/// @param buffers Vector of buffers. Their index is the "buf_index".
+/// @param nr Size of "buffers".
+/// @return "0" on success, "-1" on error.
+int URing::register_buffers(struct iovec* buffers, unsigned nr) {
+    if (syscall(__NR_io_uring_register, this->ring_fd, IORING_REGISTER_BUFFERS, buffers, nr) == -1) {
+        perror(ERROR("io_uring_register in URing::register_buffers"));
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Operations
+******************************************************************************/
+
+/// @brief Prepares an accept on a listening socket. The result of the
+///  completion is the new file descriptor, or "-errno".
+/// @param sockfd Listening socket.
+/// @param multishot If "true", a single operation keeps producing completions,
+///  one per client, while the flag IORING_CQE_F_MORE is set on them.
+/// @param user_data Value returned with the completion.
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_accept(int sockfd, bool multishot, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = sockfd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = (multishot) ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares a "recv()". Same parameters as "recv()", plus "user_data".
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_recv(int sockfd, void* buf, size_t len, int flags, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sockfd;
+    sqe->addr = (uint64_t) buf;
+    sqe->len = len;
+    sqe->msg_flags = flags;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares a "send()". Same parameters as "send()", plus "user_data".
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_send(int sockfd, const void* buf, size_t len, int flags, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = sockfd;
+    sqe->addr = (uint64_t) buf;
+    sqe->len = len;
+    sqe->msg_flags = flags | MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares a read into a registered buffer.
+/// @param fd File descriptor, like a connected socket.
+/// @param buf Where to read. Must be inside the registered buffer "buf_index".
+/// @param len Maximum amount of bytes to read.
+/// @param buf_index Index of the buffer in URing::register_buffers().
+/// @param user_data Value returned with the completion.
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_read_fixed(int fd, void* buf, size_t len, int buf_index, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) buf;
+    sqe->len = len;
+    sqe->buf_index = buf_index;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares a write from a registered buffer. Same parameters as
+///  URing::prep_read_fixed().
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_write_fixed(int fd, const void* buf, size_t len, int buf_index, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) buf;
+    sqe->len = len;
+    sqe->buf_index = buf_index;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares a single shot poll, that completes when "fd" has any of
+///  the "events" (POLLIN, POLLOUT...).
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_poll(int fd, short events, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares a timeout, that completes with -ETIME once "ts" has passed.
+///  The kernel reads "ts" when the operation is submitted.
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_timeout(const struct __kernel_timespec* ts, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t) ts;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/// @brief Prepares the cancellation of the pending operation submitted with
+///  "target" as user data. The canceled operation completes with -ECANCELED.
+/// @return "0" on success, "-1" if the submission queue is full.
+int URing::prep_cancel(uint64_t target, uint64_t user_data) {
+    struct io_uring_sqe* sqe;
+    if ( (sqe = this->get_sqe()) == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/******************************************************************************
+ * Private methods
+******************************************************************************/
+
+/// @brief Returns a free, zeroed, submission queue entry. If the queue is
+///  full, the prepared operations are submitted first.
+/// @return The entry, or NULL if the queue is still full.
+struct io_uring_sqe* URing::get_sqe(void) {
+    struct io_uring_sqe* sqe;
+    unsigned index;
+    if (this->sqe_tail - __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE) >= this->sq_entries) {
+        this->submit();
+        if (this->sqe_tail - __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE) >= this->sq_entries) {
+            return NULL;
+        }
+    }
+    index = this->sqe_tail & *this->sq_mask;
+    sqe = &this->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    this->sq_array[index] = index;
+    this->sqe_tail++;
+    return sqe;
+}
@@ -23,13 +23,29 @@ protected:
             strcat(msg_echo.text, msg_read.text);   // "echo: <msg_read.text>"
             ASSERT_EQ(socket.write(&msg_echo, sizeof(msg_t)), sizeof(msg_t));
             if (strcmp(msg_read.text, "exit") == 0) {
-                Signal::kill(getppid(), SIGINT);
+                this->on_exit_msg();
                 return;
             }
         }
     }
+    // Called after echoing an "exit" message. By default, the client is
+    // attended in a child of the server.
+    virtual void on_exit_msg(void) {
+        Signal::kill(getppid(), SIGINT);
+    }
+public:
+    EchoServer(const char* ip, const char* port, bool reuse_port=false,
+            int family=AF_UNSPEC, int socktype=SOCK_STREAM):
+        Server(ip, port, family, socktype, reuse_port) {}
+};
+
+class ThreadedEchoServer: public EchoServer {
+protected:
+    void on_exit_msg(void) override {
+        this->stop();
+    }
 public:
-    EchoServer(const char* ip, const char* port): Server(ip, port) {}
+    ThreadedEchoServer(const char* ip, const char* port): EchoServer(ip, port, true) {}
 };
 
 class ClosedConnectionServer: public Server {
@@ -42,3 +58,91 @@ protected:
 public:
     ClosedConnectionServer(const char* ip, const char* port): Server(ip, port) {}
 };
+
+class EventEchoServer: public Server {
+protected:
+    void on_accept(Socket& socket) override {}
+    void on_readable(Socket& socket) override {
+        msg_t msg_read;
+        msg_t msg_echo;
+        int bytes_read = socket.read(&msg_read, sizeof(msg_t));
+        if (bytes_read == 0) {
+            this->close_client(socket);
+            return;
+        } else if (bytes_read != sizeof(msg_t)) {
+            return;
+        }
+        strcpy(msg_echo.text, "echo: ");
+        msg_echo.number = msg_read.number;
+        strcat(msg_echo.text, msg_read.text);   // "echo: <msg_read.text>"
+        ASSERT_EQ(socket.write(&msg_echo, sizeof(msg_t)), sizeof(msg_t));
+        if (strcmp(msg_read.text, "exit") == 0) {
+            Signal::kill(getpid(), SIGINT);
+        }
+    }
+    void on_close(Socket& socket) override {
+        this->closed++;
+    }
+public:
+    int closed;
+    EventEchoServer(const char* ip, const char* port): Server(ip, port), closed(0) {}
+};
+
+
+class UringEchoServer: public Server {
+protected:
+    void on_accept(Socket& socket) override {}
+    void on_recv(Socket& socket, void* data, int len) override {
+        msg_t* msg_read = (msg_t*) data;
+        msg_t msg_echo;
+        ASSERT_EQ(len, sizeof(msg_t));
+        strcpy(msg_echo.text, "echo: ");
+        msg_echo.number = msg_read->number;
+        strcat(msg_echo.text, msg_read->text);   // "echo: <msg_read.text>"
+        ASSERT_EQ(this->queue_write(socket, &msg_echo, sizeof(msg_t)), sizeof(msg_t));
+        if (strcmp(msg_read->text, "exit") == 0) {
+            this->stop();
+        }
+    }
+    void on_close(Socket& socket) override {
+        this->closed++;
+    }
+public:
+    int closed;
+    UringEchoServer(const char* ip, const char* port): Server(ip, port), closed(0) {}
+};
+
+// Answers every message with a whole buffer of data, and stops.
+class UringFloodServer: public Server {
+protected:
+    void on_accept(Socket& socket) override {}
+    void on_recv(Socket& socket, void* data, int len) override {
+        std::vector<char> flood(this->size, 'f');
+        ASSERT_EQ(this->queue_write(socket, flood.data(), this->size), this->size);
+        this->stop();
+    }
+public:
+    int size;
+    UringFloodServer(const char* ip, const char* port, int size): Server(ip, port), size(size) {}
+};
+
+class DatagramEchoServer: public Server {
+protected:
+    void on_accept(Socket& socket) override {}
+    void on_datagram(void* data, int len, struct sockaddr* peer, socklen_t peer_len) override {
+        msg_t* msg_read = (msg_t*) data;
+        msg_t msg_echo;
+        ASSERT_EQ(len, sizeof(msg_t));
+        this->received++;
+        strcpy(msg_echo.text, "echo: ");
+        msg_echo.number = msg_read->number;
+        strcat(msg_echo.text, msg_read->text);   // "echo: <msg_read.text>"
+        ASSERT_EQ(this->queue_datagram(&msg_echo, sizeof(msg_t), peer, peer_len), sizeof(msg_t));
+        if (strcmp(msg_read->text, "exit") == 0) {
+            this->stop();
+        }
+    }
+public:
+    int received;
+    DatagramEchoServer(const char* ip, const char* port): Server(ip, port, AF_INET, SOCK_DGRAM), received(0) {}
+};
@@ -0,0 +1,27 @@
+#ifndef TEST_SOCKET_H
+#define TEST_SOCKET_H
+
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <sys/types.h>
+#include <stdio.h>
+
+/// @brief Accepts one client of "listener" into "server".
+inline void accept_client(Socket& listener, Socket& server) {
+    struct sockaddr_storage client_addr;
+    socklen_t addrlen = sizeof(struct sockaddr_storage);
+    int sockfd = accept(listener.get_sockfd(), (struct sockaddr*) &client_addr, &addrlen);
+    ASSERT_NE(sockfd, -1);
+    ASSERT_EQ(server.init(sockfd, (struct sockaddr*) &client_addr, addrlen), 0);
+}
+
+/// @brief Connects "client" to "listener", and accepts the connection into
+///  "server".
+inline void connect_pair(Socket& listener, Socket& client, Socket& server) {
+    char port[8];
+    snprintf(port, sizeof(port), "%d", listener.get_my_port());
+    ASSERT_EQ(client.connect("localhost", port, 1000, AF_INET), 0);
+    accept_client(listener, server);
+}
+
+#endif // TEST_SOCKET_H
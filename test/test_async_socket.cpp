@@ -0,0 +1,120 @@
+#include "async_socket.h"
+#include "poller.h"
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <unistd.h>
+#include <vector>
+#include "test_socket.h"
+
+/******************************************************************************
+ * Test auxiliary definitions
+******************************************************************************/
+
+struct Watermarks {
+    int high;
+    int low;
+};
+
+static void on_high(AsyncSocket& socket, void* args) {
+    ((Watermarks*) args)->high++;
+}
+
+static void on_low(AsyncSocket& socket, void* args) {
+    ((Watermarks*) args)->low++;
+}
+
+static void on_sent(const void* data, bool sent, void* args) {
+    *((int*) args) = sent ? 1 : -1;
+}
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: A peer that doesn't read fills the queue up to the high
+///  watermark without blocking, and reading drains it to the low one.
+TEST (AsyncSocketTest, Watermarks) {
+    const int chunk = 16384;
+    std::vector<char> data(chunk, 'a'), received(chunk);
+    Watermarks marks = {0, 0};
+    int ref_state = 0, written = 0, read = 0, aux;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    Socket client, server;
+    connect_pair(listener, client, server);
+    ASSERT_EQ(client.set_profile(SOCKET_PROFILE_DEFAULT, 16384), 0);
+    AsyncSocket async(client, 4 * chunk, chunk, 8 * chunk);
+    async.set_watermark_callbacks(on_high, on_low, &marks);
+    ASSERT_EQ(async.write_ref(data.data(), chunk, on_sent, &ref_state), chunk);
+    written += chunk;
+    while (!async.is_high()) {
+        ASSERT_EQ(async.write(data.data(), chunk), chunk);
+        written += chunk;
+    }
+    ASSERT_EQ(marks.high, 1);
+    ASSERT_GE(async.get_pending(), 4 * chunk);
+    while (async.get_pending() + chunk <= 8 * chunk) {
+        ASSERT_EQ(async.write(data.data(), chunk), chunk);
+        written += chunk;
+    }
+    ASSERT_EQ(async.write(data.data(), chunk), -1);
+    ASSERT_EQ(errno, ENOBUFS);
+    ASSERT_EQ(marks.high, 1);
+    while (read < written) {
+        aux = server.read(received.data(), chunk);
+        ASSERT_GT(aux, 0);
+        read += aux;
+        ASSERT_GE(async.flush(), 0);
+    }
+    ASSERT_EQ(async.get_pending(), 0);
+    ASSERT_EQ(marks.low, 1);
+    ASSERT_EQ(ref_state, 1);
+}
+
+/// @brief Tested: With a poller, the socket waits for "EPOLLOUT" only while
+///  something is queued.
+TEST (AsyncSocketTest, Poller) {
+    const int chunk = 65536;
+    std::vector<char> data(chunk, 'b'), received(chunk);
+    Poller::Event events[2];
+    int ref_state = 0, read = 0, written = 0, aux;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    Socket client, server;
+    connect_pair(listener, client, server);
+    ASSERT_EQ(client.set_profile(SOCKET_PROFILE_DEFAULT, 16384), 0);
+    Poller poller;
+    ASSERT_EQ(poller.add(client), 0);
+    {
+        AsyncSocket async(client);
+        async.set_poller(&poller);
+        ASSERT_EQ(poller.wait(events, 2, 0), 0);
+        while (async.get_pending() == 0) {
+            ASSERT_EQ(async.write(data.data(), chunk), chunk);
+            written += chunk;
+        }
+        ASSERT_EQ(async.write_ref(data.data(), chunk, on_sent, &ref_state), chunk);
+        written += chunk;
+        // Full: not writable until the peer reads.
+        ASSERT_EQ(poller.wait(events, 2, 0), 0);
+        while (async.get_pending() > 0) {
+            aux = server.read(received.data(), chunk);
+            ASSERT_GT(aux, 0);
+            read += aux;
+            if (poller.wait(events, 2, 0) == 1) {
+                ASSERT_TRUE(events[0].events & EPOLLOUT);
+                ASSERT_GE(async.flush(), 0);
+            }
+        }
+        ASSERT_EQ(ref_state, 1);
+        ASSERT_EQ(poller.wait(events, 2, 0), 0);
+        // Dropped on destruction.
+        ref_state = 0;
+        while (async.get_pending() == 0) {
+            ASSERT_EQ(async.write(data.data(), chunk), chunk);
+        }
+        ASSERT_EQ(async.write_ref(data.data(), chunk, on_sent, &ref_state), chunk);
+    }
+    ASSERT_EQ(ref_state, -1);
+    ASSERT_EQ(poller.remove(client.get_sockfd()), 0);
+}
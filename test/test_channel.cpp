@@ -0,0 +1,167 @@
+#include "channel.h"
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "test_server.h"
+#include "test_socket.h"
+
+/******************************************************************************
+ * Test auxiliary definitions
+******************************************************************************/
+
+typedef struct record_t {
+    std::string name;
+    std::vector<int> values;
+    std::vector<std::string> tags;
+} record_t;
+
+template <>
+struct Serializer<record_t> {
+    static size_t size(const record_t& value) {
+        return sizeof(uint32_t) + Serializer<std::string>::size(value.name) +
+            Serializer<std::vector<int> >::size(value.values) +
+            Serializer<std::vector<std::string> >::size(value.tags);
+    }
+    static void encode(const record_t& value, char* buffer) {
+        uint32_t len = htonl(value.name.size());
+        memcpy(buffer, &len, sizeof(len));
+        Serializer<std::string>::encode(value.name, buffer + sizeof(len));
+        buffer += sizeof(len) + value.name.size();
+        Serializer<std::vector<int> >::encode(value.values, buffer);
+        buffer += Serializer<std::vector<int> >::size(value.values);
+        Serializer<std::vector<std::string> >::encode(value.tags, buffer);
+    }
+    static bool decode(record_t& value, const char* buffer, size_t len) {
+        uint32_t name_len;
+        size_t values_len;
+        if (len < sizeof(name_len)) {
+            return false;
+        }
+        memcpy(&name_len, buffer, sizeof(name_len));
+        name_len = ntohl(name_len);
+        if (len < sizeof(name_len) + name_len + sizeof(uint32_t)) {
+            return false;
+        }
+        Serializer<std::string>::decode(value.name, buffer + sizeof(name_len), name_len);
+        buffer += sizeof(name_len) + name_len;
+        len -= sizeof(name_len) + name_len;
+        memcpy(&name_len, buffer, sizeof(name_len));
+        values_len = sizeof(uint32_t) + ntohl(name_len) * sizeof(int);
+        if (len < values_len || !Serializer<std::vector<int> >::decode(value.values, buffer, values_len)) {
+            return false;
+        }
+        return Serializer<std::vector<std::string> >::decode(value.tags, buffer + values_len, len - values_len);
+    }
+};
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: Channel with a trivially copyable type, one message at a
+///  time and in a batch.
+TEST (ChannelTest, TriviallyCopyable) {
+    int i;
+    msg_t msg;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    if (!fork()) {
+        // Client
+        Socket socket("localhost", "3000", AF_INET);
+        Channel<msg_t> channel(socket);
+        msg_t batch[10];
+        for (i=0; i<10; i++) {
+            batch[i].number = i;
+            strcpy(batch[i].text, "batch");
+        }
+        ASSERT_EQ(channel.write_batch(batch, 10), 0);
+        ASSERT_EQ(channel.read(msg), 0);
+        ASSERT_STREQ(msg.text, "done");
+        socket.close();
+        exit(0);
+    }
+    // Host
+    Socket client;
+    accept_client(listener, client);
+    Channel<msg_t> channel(client);
+    for (i=0; i<10; i++) {
+        channel >> msg;
+        ASSERT_EQ(msg.number, i);
+        ASSERT_STREQ(msg.text, "batch");
+    }
+    strcpy(msg.text, "done");
+    channel << msg;
+    ASSERT_EQ(channel.read(msg), -1);
+    ASSERT_EQ(errno, ENOTCONN);
+    client.close();
+    while (wait(NULL) != -1);
+}
+
+/// @brief Tested: Channel with strings, vectors and a user defined Serializer.
+TEST (ChannelTest, Serializer) {
+    record_t record;
+    std::vector<std::string> words;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    if (!fork()) {
+        // Client
+        Socket socket("localhost", "3000", AF_INET);
+        Channel<record_t> records(socket);
+        record.name = "sensor";
+        record.values.push_back(1);
+        record.values.push_back(-2);
+        record.tags.push_back("a");
+        record.tags.push_back("");
+        ASSERT_EQ(records.write(record, false), 0);
+        record.name = "";
+        record.values.clear();
+        record.tags.clear();
+        ASSERT_EQ(records.write(record), 0);
+        socket.close();
+        exit(0);
+    }
+    // Host
+    Socket client;
+    accept_client(listener, client);
+    Channel<record_t> records(client);
+    records >> record;
+    ASSERT_EQ(record.name, "sensor");
+    ASSERT_EQ(record.values.size(), 2);
+    ASSERT_EQ(record.values[1], -2);
+    ASSERT_EQ(record.tags.size(), 2);
+    ASSERT_EQ(record.tags[0], "a");
+    ASSERT_EQ(record.tags[1], "");
+    records >> record;
+    ASSERT_EQ(record.name, "");
+    ASSERT_TRUE(record.values.empty());
+    ASSERT_TRUE(record.tags.empty());
+    client.close();
+    while (wait(NULL) != -1);
+}
+
+/// @brief Tested: Vectors with a forged amount of elements are rejected
+///  before allocating them.
+TEST (ChannelTest, ForgedCount) {
+    std::vector<std::string> words;
+    std::vector<int> values;
+    char buffer[12];
+    uint32_t count = 0xffffffff, element_len = htonl(1);
+    memcpy(buffer, &count, sizeof(count));
+    memcpy(buffer + 4, &element_len, sizeof(element_len));
+    memcpy(buffer + 8, "abcd", 4);
+    EXPECT_FALSE(Serializer<std::vector<std::string> >::decode(words, buffer, sizeof(buffer)));
+    EXPECT_LE(words.capacity(), 2);
+    EXPECT_FALSE(Serializer<std::vector<int> >::decode(values, buffer, sizeof(buffer)));
+    count = htonl(2);
+    memcpy(buffer, &count, sizeof(count));
+    EXPECT_TRUE(Serializer<std::vector<int> >::decode(values, buffer, sizeof(buffer)));
+    EXPECT_EQ(values.size(), 2);
+    count = htonl(1);
+    element_len = htonl(4);
+    memcpy(buffer, &count, sizeof(count));
+    memcpy(buffer + 4, &element_len, sizeof(element_len));
+    EXPECT_TRUE(Serializer<std::vector<std::string> >::decode(words, buffer, sizeof(buffer)));
+    EXPECT_EQ(words[0], "abcd");
+}
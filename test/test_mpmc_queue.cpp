@@ -0,0 +1,162 @@
+#include "mpmc_queue.h"
+#include "gtest/gtest.h"
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdlib.h>
+
+/******************************************************************************
+ * Test auxiliary definitions
+******************************************************************************/
+
+struct Item {
+    int producer;   // "-1" tells the consumer to stop.
+    int value;
+};
+
+struct Total {
+    long long sum;
+    int count;
+};
+
+/// @brief Reads until a stop message, checking that each producer's values
+///  come in order, and reports the total to the queue "3".
+static void consume(int producers) {
+    MpmcQueue<Item> queue(".", 2);
+    MpmcQueue<Total> results(".", 3);
+    Total total = {0, 0};
+    int last[8];
+    bool in_order = true;
+    Item item;
+    for (int i = 0; i < producers; i++) {
+        last[i] = -1;
+    }
+    for (;;) {
+        queue >> item;
+        if (item.producer == -1) {
+            break;
+        }
+        in_order = in_order && item.value > last[item.producer];
+        last[item.producer] = item.value;
+        total.sum += item.value;
+        total.count++;
+    }
+    results << total;
+    _exit(in_order ? 0 : 1);
+}
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: IO operations, and the non-blocking ones on an empty and a
+///  full queue.
+TEST (MpmcQueueTest, IntType) {
+    int value;
+    MpmcQueue<int> queue(".", 2, true, 3);
+    EXPECT_EQ(queue.get_capacity(), 4);
+    EXPECT_EQ(queue.try_read(value), -1);
+    EXPECT_EQ(errno, ENOMSG);
+    EXPECT_EQ(queue.read_into(value, 0, IPC_NOWAIT), -1);
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            queue << i;
+        }
+        EXPECT_EQ(queue.try_write(4), -1);
+        EXPECT_EQ(errno, EAGAIN);
+        EXPECT_EQ(queue.get_msg_qtty(), 4);
+        for (int i = 0; i < 4; i++) {
+            queue >> value;
+            EXPECT_EQ(value, i);
+        }
+        EXPECT_TRUE(queue.is_empty());
+    }
+    EXPECT_EQ(queue.recover(getpid()), 0);
+    EXPECT_TRUE(MpmcQueue<int>::exists(".", 2));
+}
+
+/// @brief Tested: Several producers and consumers in different processes,
+///  through a small queue so every side sleeps now and then.
+TEST (MpmcQueueTest, Processes) {
+    const int producers = 3, consumers = 2, count = 20000;
+    pid_t pids[producers + consumers];
+    Item item;
+    Total total, all = {0, 0};
+    int status;
+    MpmcQueue<Item> queue(".", 2, true, 8);
+    MpmcQueue<Total> results(".", 3, true, 8);
+    for (int c = 0; c < consumers; c++) {
+        if ( (pids[c] = fork() ) == 0) {
+            consume(producers);
+        }
+    }
+    for (int p = 0; p < producers; p++) {
+        if ( (pids[consumers + p] = fork() ) == 0) {
+            MpmcQueue<Item> child_queue(".", 2);
+            item.producer = p;
+            for (int i = 0; i < count; i++) {
+                item.value = i;
+                child_queue << item;
+            }
+            _exit(0);
+        }
+    }
+    for (int p = 0; p < producers; p++) {
+        waitpid(pids[consumers + p], &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    item.producer = -1;
+    for (int c = 0; c < consumers; c++) {
+        queue << item;
+    }
+    for (int c = 0; c < consumers; c++) {
+        results >> total;
+        all.sum += total.sum;
+        all.count += total.count;
+        waitpid(pids[c], &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    EXPECT_EQ(all.count, producers * count);
+    EXPECT_EQ(all.sum, (long long) producers * count * (count - 1) / 2);
+    EXPECT_TRUE(queue.is_empty());
+}
+
+/// @brief Tested: Producers killed at any point leave the queue usable, with
+///  every message that was completely written.
+TEST (MpmcQueueTest, CrashedProcess) {
+    int last[2] = {-1, -1}, status;
+    Item item;
+    pid_t pids[2];
+    MpmcQueue<Item> queue(".", 2, true, 16);
+    for (int p = 0; p < 2; p++) {
+        if ( (pids[p] = fork() ) == 0) {
+            MpmcQueue<Item> child_queue(".", 2);
+            item.producer = p;
+            for (item.value = 0; ; item.value++) {
+                child_queue << item;
+            }
+        }
+    }
+    for (int i = 0; i < 1000; i++) {
+        queue >> item;
+        ASSERT_GT(item.value, last[item.producer]);
+        last[item.producer] = item.value;
+    }
+    for (int p = 0; p < 2; p++) {
+        kill(pids[p], SIGKILL);
+        waitpid(pids[p], &status, 0);
+        EXPECT_GE(queue.recover(pids[p]), 0);
+    }
+    while (queue.try_read(item) == 0) {
+        ASSERT_GT(item.value, last[item.producer]);
+        last[item.producer] = item.value;
+    }
+    EXPECT_EQ(errno, ENOMSG);
+    for (int round = 0; round < 40; round++) {
+        item.producer = 0;
+        item.value = round;
+        EXPECT_EQ(queue.try_write(item), 0);
+        EXPECT_EQ(queue.try_read(item), 0);
+        EXPECT_EQ(item.value, round);
+    }
+    EXPECT_TRUE(queue.is_empty());
+}
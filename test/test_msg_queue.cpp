@@ -113,3 +113,98 @@ TEST(MsgQueueTest, Priority) {
     EXPECT_EQ(queue.read(-4), 2);   // Read higher priority available, should read 2.
     EXPECT_EQ(queue.read(), 4);     // First one.
 }
+
+/// @brief Tested: write_many(), read_many() and read_into().
+TEST(MsgQueueTest, Batches) {
+    MsgQueue<int> queue(".", 2, true);
+    int values[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    int read_values[8];
+    int value;
+    EXPECT_EQ(queue.write_many(values, 5), 5);
+    EXPECT_EQ(queue.write_many(values + 5, 3, 2), 3);
+    EXPECT_EQ(queue.read_many(read_values, 8, 1), 5);  // Only the ones there.
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(read_values[i], i);
+    }
+    EXPECT_EQ(queue.read_into(value, 2), 0);
+    EXPECT_EQ(value, 5);
+    EXPECT_EQ(queue.read_many(read_values, 8), 2);
+    EXPECT_EQ(read_values[1], 7);
+    EXPECT_EQ(queue.read_many(read_values, 8, 0, IPC_NOWAIT), -1);
+    EXPECT_EQ(errno, ENOMSG);
+    EXPECT_EQ(queue.read_into(value, 0, IPC_NOWAIT), -1);
+}
+
+/// @brief Tested: write_msg() and read_msg() with messages shorter than the
+///  type, built and read in place.
+TEST(MsgQueueTest, VariableLength) {
+    struct command {
+        int code;
+        char payload[1024];
+    };
+    MsgQueue<struct command> queue(".", 2, true);
+    MsgQueue<struct command>::Message message;
+    message.mtype = 3;
+    message.msg.code = 7;
+    strcpy(message.msg.payload, "go");
+    size_t len = offsetof(struct command, payload) + strlen("go") + 1;
+    EXPECT_EQ(queue.write_msg(message, len), 0);
+    EXPECT_EQ(queue.write_msg(message, sizeof(struct command) + 1), -1);
+    EXPECT_EQ(errno, EINVAL);
+    memset(&message, 0, sizeof(message));
+    EXPECT_EQ(queue.read_msg(message), (ssize_t) len);
+    EXPECT_EQ(message.mtype, 3);
+    EXPECT_EQ(message.msg.code, 7);
+    EXPECT_STREQ(message.msg.payload, "go");
+    EXPECT_EQ(queue.read_msg(message, 0, IPC_NOWAIT), -1);
+}
+
+/// @brief Tested: set_capacity(), and the overflow policies on a full queue.
+TEST(MsgQueueTest, Overflow) {
+    MsgQueue<int> queue(".", 2, true);
+    int value;
+    EXPECT_EQ(queue.set_capacity(4 * sizeof(int)), 0);
+    EXPECT_EQ(queue.get_capacity(), (long) (4 * sizeof(int)));
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(queue.try_write(i), 0);
+    }
+    EXPECT_EQ(queue.try_write(4), -1);
+    EXPECT_EQ(errno, EAGAIN);
+    EXPECT_EQ(queue.write_timed(4, 20), -1);
+    EXPECT_EQ(errno, ETIMEDOUT);
+    queue.set_overflow_policy(MSG_QUEUE_FAIL);
+    EXPECT_EQ(queue.write(4), -1);
+    EXPECT_EQ(errno, EAGAIN);
+    queue.set_overflow_policy(MSG_QUEUE_DROP_NEWEST);
+    EXPECT_EQ(queue.write(4), 0);
+    queue.set_overflow_policy(MSG_QUEUE_DROP_OLDEST);
+    EXPECT_EQ(queue.write(5), 0);
+    EXPECT_EQ(queue.try_write(6), 0);
+    EXPECT_EQ(queue.get_msg_qtty(), 4);
+    for (int i = 2; i < 4; i++) {
+        queue >> value;
+        EXPECT_EQ(value, i);
+    }
+    queue >> value;
+    EXPECT_EQ(value, 5);
+    queue >> value;
+    EXPECT_EQ(value, 6);
+}
+
+/// @brief Tested: Capacities that can't hold a message are rejected, and
+///  dropping the oldest message fails when the new one never fits.
+TEST(MsgQueueTest, OverflowTooBig) {
+    MsgQueue<int> queue(".", 2, true);
+    struct msqid_ds info;
+    int msg_id = msgget(ftok(".", 2), 0);
+    EXPECT_EQ(queue.set_capacity(sizeof(int) - 1), -1);
+    EXPECT_EQ(errno, EINVAL);
+    // Set by another process, the capacity isn't checked.
+    ASSERT_EQ(msgctl(msg_id, IPC_STAT, &info), 0);
+    info.msg_qbytes = sizeof(int) - 1;
+    ASSERT_EQ(msgctl(msg_id, IPC_SET, &info), 0);
+    queue.set_overflow_policy(MSG_QUEUE_DROP_OLDEST);
+    EXPECT_EQ(queue.write(1), -1);
+    EXPECT_EQ(errno, EMSGSIZE);
+    EXPECT_TRUE(queue.is_empty());
+}
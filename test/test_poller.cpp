@@ -0,0 +1,96 @@
+#include "poller.h"
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <unistd.h>
+#include "test_socket.h"
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: Several sockets in one poller, with level and edge triggered
+///  interest, and the user data of each one.
+TEST (PollerTest, Sockets) {
+    Poller::Event events[4];
+    char buff[4];
+    int tag = 7;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 2), 0);
+    Socket client_a("localhost", "3000", AF_INET), client_b("localhost", "3000", AF_INET);
+    Socket server_a, server_b;
+    accept_client(listener, server_a);
+    accept_client(listener, server_b);
+    Poller poller;
+    ASSERT_EQ(poller.add(server_a), 0);
+    ASSERT_EQ(poller.add(server_b, EPOLLIN, true, &tag), 0);
+    ASSERT_EQ(poller.add(server_a), -1);
+    ASSERT_EQ(errno, EEXIST);
+    ASSERT_EQ(poller.get_size(), 2);
+    ASSERT_EQ(poller.wait(events, 4, 0), 0);
+
+    ASSERT_EQ(client_a.write((void*) "a", 1), 1);
+    ASSERT_EQ(client_b.write((void*) "b", 1), 1);
+    usleep(10000);
+    ASSERT_EQ(poller.wait(events, 4, 1000), 2);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_TRUE(events[i].events & EPOLLIN);
+        ASSERT_EQ(events[i].type, Poller::SOCKET);
+        if (events[i].fd == server_a.get_sockfd()) {
+            ASSERT_EQ(events[i].data, &server_a);
+        } else {
+            ASSERT_EQ(events[i].fd, server_b.get_sockfd());
+            ASSERT_EQ(events[i].data, &tag);
+        }
+    }
+    // Nothing was read: only the level triggered one is reported again.
+    ASSERT_EQ(poller.wait(events, 4, 0), 1);
+    ASSERT_EQ(events[0].fd, server_a.get_sockfd());
+    ASSERT_EQ(server_a.read(buff, sizeof(buff)), 1);
+    ASSERT_EQ(server_b.read(buff, sizeof(buff)), 1);
+    ASSERT_EQ(poller.wait(events, 4, 0), 0);
+
+    ASSERT_EQ(poller.modify(server_a.get_sockfd(), EPOLLOUT), 0);
+    ASSERT_EQ(poller.wait(events, 4, 0), 1);
+    ASSERT_TRUE(events[0].events & EPOLLOUT);
+    ASSERT_EQ(poller.remove(server_a.get_sockfd()), 0);
+    ASSERT_EQ(poller.remove(server_a.get_sockfd()), -1);
+    ASSERT_EQ(errno, ENOENT);
+    // Sockets are not closed by the poller.
+    ASSERT_EQ(server_a.write((void*) "a", 1), 1);
+}
+
+/// @brief Tested: Eventfds, timers and signals handled as events.
+TEST (PollerTest, EventsTimersSignals) {
+    Poller::Event events[4];
+    uint64_t value;
+    int event_fd, timer_fd, signal_fd;
+    Poller poller;
+    ASSERT_NE( (event_fd = poller.add_event() ), -1);
+    ASSERT_NE( (timer_fd = poller.add_timer(20, false) ), -1);
+    ASSERT_NE( (signal_fd = poller.add_signal(SIGUSR1) ), -1);
+    ASSERT_EQ(poller.wait(events, 4, 0), 0);
+
+    ASSERT_EQ(Poller::notify(event_fd, 2), 0);
+    ASSERT_EQ(Poller::notify(event_fd), 0);
+    ASSERT_EQ(poller.wait(events, 4, 0), 1);
+    ASSERT_EQ(events[0].type, Poller::EVENT);
+    ASSERT_EQ(Poller::consume(event_fd, &value), 0);
+    ASSERT_EQ(value, 3);
+    ASSERT_EQ(Poller::consume(event_fd), -1);
+    ASSERT_EQ(errno, EAGAIN);
+
+    ASSERT_EQ(poller.wait(events, 4, 1000), 1);
+    ASSERT_EQ(events[0].fd, timer_fd);
+    ASSERT_EQ(events[0].type, Poller::TIMER);
+    ASSERT_EQ(Poller::consume(timer_fd, &value), 0);
+    ASSERT_EQ(value, 1);
+
+    ASSERT_EQ(Signal::kill(getpid(), SIGUSR1), 0);
+    ASSERT_EQ(poller.wait(events, 4, 1000), 1);
+    ASSERT_EQ(events[0].type, Poller::SIGNAL);
+    ASSERT_EQ(Poller::read_signal(signal_fd), SIGUSR1);
+    ASSERT_EQ(Poller::read_signal(signal_fd), -1);
+    ASSERT_EQ(poller.remove(timer_fd), 0);
+    ASSERT_EQ(poller.get_size(), 2);
+    ASSERT_EQ(Signal::unblock(SIGUSR1), 0);
+}
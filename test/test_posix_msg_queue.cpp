@@ -0,0 +1,106 @@
+#include "posix_msg_queue.h"
+#include "msg_queue.h"
+#include "poller.h"
+#include "gtest/gtest.h"
+#include <sys/wait.h>
+#include <string.h>
+
+/// @brief Tested: IO operations with int type, between processes.
+TEST (PosixMsgQueueTest, IntType) {
+    PosixMsgQueue<int>queue(".", 2, true);
+    for (int i = 0; i < 5; i++) {
+        queue << i;
+    }
+    EXPECT_EQ(queue.get_msg_qtty(), 5);
+    if (!fork()) {
+        int sum_of_values = 0, value_read;
+        PosixMsgQueue<int>child_queue(".", 2);
+        for (int i = 0; i < 5; i++) {
+            child_queue >> value_read;
+            sum_of_values += value_read;
+        }
+        child_queue << sum_of_values;
+        _exit(0);
+    }
+    wait(NULL);
+    EXPECT_EQ(queue.read(), 10);
+    EXPECT_TRUE(queue.is_empty());
+    EXPECT_TRUE(PosixMsgQueue<int>::exists(".", 2));
+}
+
+/// @brief Tested: Higher priorities are read first, and the non-blocking and
+///  timed reads.
+TEST (PosixMsgQueueTest, Priorities) {
+    PosixMsgQueue<int>::Message message;
+    int value = 0;
+    long priority;
+    PosixMsgQueue<int>queue(".", 2, true, 4);
+    EXPECT_EQ(queue.read_into(value, 0, IPC_NOWAIT), -1);
+    EXPECT_EQ(errno, ENOMSG);
+    EXPECT_EQ(queue.read_timed(value, 20), -1);
+    EXPECT_EQ(errno, ETIMEDOUT);
+    EXPECT_EQ(queue.write(1, 1), 0);
+    EXPECT_EQ(queue.write(2, 5), 0);
+    EXPECT_EQ(queue.write(3, 5), 0);
+    message.mtype = 0;
+    message.msg = 4;
+    EXPECT_EQ(queue.write_msg(message), 0);
+    EXPECT_EQ(queue.write_msg(message, sizeof(int), IPC_NOWAIT), -1);
+    EXPECT_EQ(errno, EAGAIN);
+    EXPECT_EQ(queue.read_timed(value, 20, &priority), 0);
+    EXPECT_EQ(value, 2);
+    EXPECT_EQ(priority, 5);
+    EXPECT_EQ(queue.read_msg(message), (ssize_t) sizeof(int));
+    EXPECT_EQ(message.msg, 3);
+    EXPECT_EQ(queue.read(), 1);
+    EXPECT_EQ(queue.read(), 4);
+    EXPECT_EQ(queue.read_into(value, 1), -1);
+    EXPECT_EQ(errno, EINVAL);
+}
+
+/// @brief Tested: The queue waited on with a Poller.
+TEST (PosixMsgQueueTest, Poller) {
+    Poller::Event events[2];
+    int values[4];
+    PosixMsgQueue<int>queue(".", 2, true);
+    Poller poller;
+    ASSERT_EQ(poller.add(queue.get_fd(), EPOLLIN, false, &queue), 0);
+    EXPECT_EQ(poller.wait(events, 2, 0), 0);
+    int written[3] = {7, 8, 9};
+    EXPECT_EQ(queue.write_many(written, 3), 3);
+    ASSERT_EQ(poller.wait(events, 2, 1000), 1);
+    EXPECT_EQ(events[0].fd, queue.get_fd());
+    EXPECT_EQ(events[0].data, &queue);
+    EXPECT_EQ(queue.read_many(values, 4), 3);
+    EXPECT_EQ(values[2], 9);
+    EXPECT_EQ(poller.wait(events, 2, 0), 0);
+    EXPECT_EQ(poller.remove(queue.get_fd()), 0);
+}
+
+/// @brief Writes and reads a message with either backend.
+template <template <class> class Queue>
+static int round_trip(int id) {
+    Queue<int> queue(".", id, true);
+    int value;
+    queue << 21;
+    queue >> value;
+    return value * 2;
+}
+
+/// @brief Tested: The same code works with both backends.
+TEST (PosixMsgQueueTest, Alias) {
+    EXPECT_EQ(round_trip<MsgQueue>(2), 42);
+    EXPECT_EQ(round_trip<PosixMsgQueue>(2), 42);
+}
+
+/// @brief Tested: PosixMsgQueue::PosixMsgQueue()
+TEST (PosixMsgQueueTest, Creation) {
+    EXPECT_FALSE(PosixMsgQueue<int>::exists(".", 2));
+    EXPECT_THROW(PosixMsgQueue<int>(".", 2), std::runtime_error);
+    {
+        PosixMsgQueue<int>queue(".", 2, true);
+        EXPECT_THROW(PosixMsgQueue<int>(".", 2, true), std::runtime_error);
+        EXPECT_THROW(PosixMsgQueue<long long>(".", 2), std::runtime_error);
+    }
+    EXPECT_FALSE(PosixMsgQueue<int>::exists(".", 2));
+}
@@ -0,0 +1,89 @@
+#include "resolver.h"
+#include "socket.h"
+#include "sem.h"
+#include "gtest/gtest.h"
+#include <unistd.h>
+
+/******************************************************************************
+ * Test auxiliary definitions
+******************************************************************************/
+
+class ResolverTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Resolver::clear();
+        Resolver::set_ttl(30000, 5000);
+    }
+    void TearDown() override {
+        Resolver::clear();
+        Resolver::set_ttl(30000, 5000);
+    }
+};
+
+static int g_status;
+static size_t g_addrs;
+
+void on_resolved(int status, const std::vector<Resolver::Address>& addrs, void* args) {
+    g_status = status;
+    g_addrs = addrs.size();
+    (*(Sem*) args)++;
+}
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: successful lookups are cached until their TTL expires, and
+///  used by Socket.
+TEST_F (ResolverTest, Cache) {
+    std::vector<Resolver::Address> addrs;
+    Resolver::set_ttl(100, 100);
+    ASSERT_FALSE(Resolver::is_cached("localhost", "3000", AF_INET, SOCK_STREAM));
+    ASSERT_EQ(Resolver::resolve("localhost", "3000", AF_INET, SOCK_STREAM, addrs), 0);
+    ASSERT_GT(addrs.size(), 0);
+    ASSERT_EQ(addrs[0].family, AF_INET);
+    ASSERT_TRUE(Resolver::is_cached("localhost", "3000", AF_INET, SOCK_STREAM));
+    ASSERT_FALSE(Resolver::is_cached("localhost", "3000", AF_INET6, SOCK_STREAM));
+    ASSERT_FALSE(Resolver::is_cached("localhost", "3001", AF_INET, SOCK_STREAM));
+    usleep(150000);
+    ASSERT_FALSE(Resolver::is_cached("localhost", "3000", AF_INET, SOCK_STREAM));
+    ASSERT_FALSE(Socket::is_listening("localhost", "3000", AF_INET));
+    ASSERT_TRUE(Resolver::is_cached("localhost", "3000", AF_INET, SOCK_STREAM));
+}
+
+/// @brief Tested: failed lookups are cached with the negative TTL.
+TEST_F (ResolverTest, NegativeCache) {
+    std::vector<Resolver::Address> addrs;
+    Resolver::set_ttl(30000, 100);
+    ASSERT_NE(Resolver::resolve("nonexistent.invalid", "3000", AF_UNSPEC, SOCK_STREAM, addrs), 0);
+    ASSERT_TRUE(addrs.empty());
+    ASSERT_TRUE(Resolver::is_cached("nonexistent.invalid", "3000", AF_UNSPEC, SOCK_STREAM));
+    usleep(150000);
+    ASSERT_FALSE(Resolver::is_cached("nonexistent.invalid", "3000", AF_UNSPEC, SOCK_STREAM));
+}
+
+/// @brief Tested: a NULL port, which is not the same as an empty one.
+TEST_F (ResolverTest, NullPort) {
+    std::vector<Resolver::Address> addrs;
+    ASSERT_EQ(Resolver::resolve("localhost", NULL, AF_INET, SOCK_STREAM, addrs), 0);
+    ASSERT_GT(addrs.size(), 0);
+    ASSERT_TRUE(Resolver::is_cached("localhost", NULL, AF_INET, SOCK_STREAM));
+    ASSERT_FALSE(Resolver::is_cached("localhost", "", AF_INET, SOCK_STREAM));
+}
+
+/// @brief Tested: Resolver::resolve_async(), on a helper thread and from the
+///  cache.
+TEST_F (ResolverTest, Async) {
+    Sem sem(".", 2, true);
+    sem = 0;
+    g_status = -1;
+    ASSERT_EQ(Resolver::resolve_async("localhost", "3000", AF_INET, SOCK_STREAM, on_resolved, &sem), 0);
+    sem--;
+    ASSERT_EQ(g_status, 0);
+    ASSERT_GT(g_addrs, 0);
+    ASSERT_TRUE(Resolver::is_cached("localhost", "3000", AF_INET, SOCK_STREAM));
+    g_status = -1;
+    ASSERT_EQ(Resolver::resolve_async("localhost", "3000", AF_INET, SOCK_STREAM, on_resolved, &sem), 0);
+    ASSERT_EQ(g_status, 0);
+    sem--;
+}
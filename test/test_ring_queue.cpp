@@ -0,0 +1,79 @@
+#include "ring_queue.h"
+#include "gtest/gtest.h"
+#include <sys/wait.h>
+#include <string.h>
+#include <stdlib.h>
+
+/// @brief Tested: IO operations with int type, and the non-blocking ones on an
+///  empty and a full ring.
+TEST (RingQueueTest, IntType) {
+    int value;
+    RingQueue<int>queue(".", 2, true, 5);
+    EXPECT_EQ(queue.get_capacity(), 8);
+    EXPECT_TRUE(queue.is_empty());
+    EXPECT_EQ(queue.read_into(value, 0, IPC_NOWAIT), -1);
+    EXPECT_EQ(errno, ENOMSG);
+    for (int i = 0; i < 8; i++) {
+        queue << i;
+    }
+    EXPECT_EQ(queue.write(8, 1, IPC_NOWAIT), -1);
+    EXPECT_EQ(errno, EAGAIN);
+    EXPECT_EQ(queue.get_msg_qtty(), 8);
+    RingQueue<int>other(".", 2);
+    EXPECT_EQ(other.get_capacity(), 8);
+    for (int i = 0; i < 8; i++) {
+        other >> value;
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.has_msg());
+    EXPECT_TRUE(RingQueue<int>::exists(".", 2));
+}
+
+/// @brief Tested: A producer and a consumer in different processes, through a
+///  ring much smaller than the amount of messages, so both sides sleep.
+TEST (RingQueueTest, Processes) {
+    struct point {
+        int x;
+        int y;
+    };
+    const int count = 100000;
+    struct point data;
+    int status;
+    long long sum = 0;
+    RingQueue<struct point>queue(".", 2, true, 16);
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+        RingQueue<struct point>child_queue(".", 2);
+        for (int i = 0; i < count; i++) {
+            data.x = i;
+            data.y = -i;
+            child_queue << data;
+        }
+        _exit(0);
+    }
+    for (int i = 0; i < count; i++) {
+        data = queue.read(0, &status);
+        ASSERT_EQ(status, 0);
+        ASSERT_EQ(data.x, i);
+        ASSERT_EQ(data.y, -i);
+        sum += data.x;
+    }
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    EXPECT_EQ(sum, (long long) count * (count - 1) / 2);
+    EXPECT_TRUE(queue.is_empty());
+}
+
+/// @brief Tested: RingQueue::RingQueue()
+TEST (RingQueueTest, Creation) {
+    EXPECT_FALSE(RingQueue<int>::exists(".", 2));
+    EXPECT_THROW(RingQueue<int>(".", 2), std::runtime_error);
+    EXPECT_THROW(RingQueue<int>(".", 2, true, 0), std::runtime_error);
+    {
+        RingQueue<int>queue(".", 2, true);
+        EXPECT_EQ(queue.get_capacity(), 1024);
+        EXPECT_THROW(RingQueue<int>(".", 2, true), std::runtime_error);
+    }
+    EXPECT_FALSE(RingQueue<int>::exists(".", 2));
+}
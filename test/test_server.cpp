@@ -155,6 +155,9 @@ TEST (ServerTest, CloseServerConnection) {
         EXPECT_STREQ(msg.text, "echo: exit");
         wait(NULL); // SIGCHLD ignore is on the child process.
         ASSERT_FALSE(Socket::is_listening("localhost", "3000"));
+        // The client is attended by a child of the server, which may still be
+        // closing the connection.
+        ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), 0);
         // You need two writes to detect that the socket was closed.
         // Data is buffered, first "send()" returns ok, and when you call the
         // second "send()", the broken pipe is detected.
@@ -162,3 +165,401 @@ TEST (ServerTest, CloseServerConnection) {
         ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), -1);
     }
 }
+
+/// @brief Tested: Server::start_event_loop(), with multiple clients attended
+///  by two reactors in the same process.
+TEST (ServerTest, EventLoop) {
+    uint8_t i;
+    Sem g_sem(".", 2, true);
+    g_sem = 0;
+    for (i=0; i<5; i++) {
+        if (!fork()) {
+            // Client
+            while(!Socket::is_listening("localhost", "3000"));
+            Socket socket("localhost", "3000");
+            msg_t msg;
+            msg.number = i;
+            if (i == 4) {
+                g_sem.op(-4);
+                strcpy(msg.text, "exit");
+            } else {
+                strcpy(msg.text, "hello");
+            }
+            ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_EQ(msg.number, i);
+            ASSERT_STREQ(msg.text, (i == 4) ? "echo: exit" : "echo: hello");
+            if (i != 4) {
+                g_sem++;
+            }
+            socket.close();
+            exit(0);
+        }
+    }
+    // Host
+    EventEchoServer server("localhost", "3000");
+    server.start_event_loop(20, 2);
+    EXPECT_GT(server.closed, 0);
+    while (wait(NULL) != -1);
+    ASSERT_FALSE(Socket::is_listening("localhost", "3000"));
+}
+
+/// @brief Tested: Server::start_prefork(), clients attended by a pool of
+///  workers sharing the port with SO_REUSEPORT.
+TEST (ServerTest, PreforkWorkers) {
+    uint8_t i;
+    Sem g_sem(".", 2, true);
+    g_sem = 0;
+    for (i=0; i<5; i++) {
+        if (!fork()) {
+            // Client. A worker attends one client at a time, so the last
+            // one can't hold a connection while waiting for the others.
+            if (i == 4) {
+                g_sem.op(-4);
+            }
+            while(!Socket::is_listening("localhost", "3000"));
+            Socket socket("localhost", "3000");
+            msg_t msg;
+            msg.number = i;
+            if (i == 4) {
+                strcpy(msg.text, "exit");
+            } else {
+                strcpy(msg.text, "hello");
+            }
+            ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_STREQ(msg.text, (i == 4) ? "echo: exit" : "echo: hello");
+            if (i != 4) {
+                g_sem++;
+            }
+            socket.close();
+            exit(0);
+        }
+    }
+    // Host
+    EchoServer server("localhost", "3000", true);
+    server.start_prefork(3, 20, true);
+    while (wait(NULL) != -1);
+    ASSERT_FALSE(Socket::is_listening("localhost", "3000"));
+}
+
+void* threaded_server_run (void* server) {
+    ((Server*) server)->start_threaded(2);
+    return NULL;
+}
+
+/// @brief Tested: Server::start_threaded() and Server::stop(), with two
+///  servers in the same process stopped independently.
+TEST (ServerTest, ThreadedServers) {
+    msg_t msg;
+    ThreadedEchoServer first("localhost", "3000");
+    ThreadedEchoServer second("localhost", "3001");
+    Thread first_thread(threaded_server_run, &first);
+    Thread second_thread(threaded_server_run, &second);
+    while(!Socket::is_listening("localhost", "3000"));
+    while(!Socket::is_listening("localhost", "3001")) {}
+    {
+        Socket socket("localhost", "3000");
+        msg.number = 0;
+        strcpy(msg.text, "exit");
+        ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_STREQ(msg.text, "echo: exit");
+        socket.close();
+    }
+    first_thread.join();
+    EXPECT_FALSE(Socket::is_listening("localhost", "3000"));
+    {
+        // The second server is still up.
+        Socket socket("localhost", "3001");
+        msg.number = 1;
+        strcpy(msg.text, "second");
+        ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_STREQ(msg.text, "echo: second");
+        socket.close();
+    }
+    second.stop();
+    second_thread.join();
+    EXPECT_FALSE(Socket::is_listening("localhost", "3001"));
+}
+
+
+/// @brief Tested: Server::start_uring(), reads and writes through io_uring
+///  (or the event loop fallback) with on_recv() and queue_write().
+TEST (ServerTest, Uring) {
+    uint8_t i;
+    Sem g_sem(".", 2, true);
+    g_sem = 0;
+    for (i=0; i<5; i++) {
+        if (!fork()) {
+            // Client
+            while(!Socket::is_listening("localhost", "3000"));
+            Socket socket("localhost", "3000");
+            msg_t msg;
+            msg.number = i;
+            if (i == 4) {
+                g_sem.op(-4);
+                strcpy(msg.text, "exit");
+            } else {
+                strcpy(msg.text, "hello");
+            }
+            ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_EQ(msg.number, i);
+            ASSERT_STREQ(msg.text, (i == 4) ? "echo: exit" : "echo: hello");
+            if (i != 4) {
+                g_sem++;
+            }
+            socket.close();
+            exit(0);
+        }
+    }
+    // Host
+    UringEchoServer server("localhost", "3000");
+    // Each client also connects once in Socket::is_listening().
+    server.start_uring(20, 16, sizeof(msg_t));
+    EXPECT_GT(server.closed, 0);
+    while (wait(NULL) != -1);
+    ASSERT_FALSE(Socket::is_listening("localhost", "3000"));
+}
+
+/// @brief Tested: Server::start_uring() stops even if a client never reads
+///  the reply being sent.
+TEST (ServerTest, UringStopWriting) {
+    const int size = 512 * 1024;
+    int small = 4096;
+    msg_t msg;
+    struct timespec start, end;
+    pid_t pid = fork();
+    if (pid == 0) {
+        while(!Socket::is_listening("localhost", "3000"));
+        Socket socket("localhost", "3000");
+        setsockopt(socket.get_sockfd(), SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        strcpy(msg.text, "flood");
+        socket.write(&msg, sizeof(msg_t));
+        sleep(10);
+        exit(0);
+    }
+    UringFloodServer server("localhost", "3000", size);
+    ASSERT_EQ(setsockopt(server.get_socket().get_sockfd(), SOL_SOCKET, SO_SNDBUF, &small, sizeof(small)), 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    server.start_uring(20, 2, size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    EXPECT_LT(end.tv_sec - start.tv_sec, 5);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+/// @brief Tested: Server::start() with "SOCK_DGRAM", Socket::write_batch() and
+///  Socket::read_batch().
+TEST (ServerTest, Datagrams) {
+    int i, received;
+    DatagramEchoServer server("localhost", "3000");
+    if (!fork()) {
+        // Client
+        Socket socket("localhost", "3000", AF_INET, SOCK_DGRAM);
+        msg_t msgs[4];
+        struct iovec iov[4];
+        struct mmsghdr hdrs[4];
+        memset(hdrs, 0, sizeof(hdrs));
+        for (i=0; i<4; i++) {
+            msgs[i].number = i;
+            strcpy(msgs[i].text, (i == 3) ? "exit" : "hello");
+            iov[i].iov_base = &msgs[i];
+            iov[i].iov_len = sizeof(msg_t);
+            hdrs[i].msg_hdr.msg_iov = &iov[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        ASSERT_EQ(socket.write_batch(hdrs, 3), 3);
+        memset(msgs, 0, sizeof(msgs));
+        for (received=0; received<3; ) {
+            i = socket.read_batch(hdrs + received, 3 - received, MSG_WAITFORONE);
+            ASSERT_GT(i, 0);
+            received += i;
+        }
+        for (i=0; i<3; i++) {
+            ASSERT_EQ(hdrs[i].msg_len, sizeof(msg_t));
+            ASSERT_STREQ(msgs[i].text, "echo: hello");
+        }
+        msgs[3].number = 3;
+        strcpy(msgs[3].text, "exit");
+        ASSERT_EQ(socket.write_batch(hdrs + 3, 1), 1);
+        ASSERT_EQ(socket.read(&msgs[3], sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_EQ(msgs[3].number, 3);
+        ASSERT_STREQ(msgs[3].text, "echo: exit");
+        exit(0);
+    }
+    // Host
+    server.start();
+    EXPECT_EQ(server.received, 4);
+    while (wait(NULL) != -1);
+}
+
+/// @brief Tested: Socket::writev(), Socket::readv() and SocketMsg, with the
+///  fields of each message in separate buffers.
+TEST (ServerTest, ScatterGather) {
+    if (!fork()) {
+        // Client
+        while(!Socket::is_listening("localhost", "3000"));
+        Socket socket("localhost", "3000");
+        msg_t msg;
+        SocketMsg fields;
+        struct iovec iov[2];
+        int number = 1;
+        memset(msg.text, 0, sizeof(msg.text));
+        strcpy(msg.text, "hello");
+        // Text, padding and number, as in msg_t.
+        fields.add(msg.text, offsetof(msg_t, number)) << number;
+        ASSERT_EQ(fields.get_len(), sizeof(msg_t));
+        socket << fields;
+        iov[0].iov_base = msg.text;
+        iov[0].iov_len = offsetof(msg_t, number);
+        iov[1].iov_base = &number;
+        iov[1].iov_len = sizeof(int);
+        number = 0;
+        ASSERT_EQ(socket.readv(iov, 2, MSG_WAITALL), sizeof(msg_t));
+        ASSERT_STREQ(msg.text, "echo: hello");
+        ASSERT_EQ(number, 1);
+        memset(msg.text, 0, sizeof(msg.text));
+        strcpy(msg.text, "exit");
+        number = 2;
+        ASSERT_EQ(socket.writev(iov, 2), sizeof(msg_t));
+        ASSERT_EQ(socket.readv(iov, 2, MSG_WAITALL), sizeof(msg_t));
+        ASSERT_STREQ(msg.text, "echo: exit");
+        ASSERT_EQ(number, 2);
+        socket.close();
+        exit(0);
+    }
+    // Host
+    EchoServer server("localhost", "3000");
+    server.start();
+    while (wait(NULL) != -1);
+}
+
+/// @brief Tested: Unix domain stream sockets bound to a path, which is
+///  reused after a previous run left its socket file behind, but not while a
+///  server runs on it, and is removed when the server is done.
+TEST (ServerTest, UnixStream) {
+    const char* path = "/tmp/ipc_testing.sock";
+    if (!fork()) {
+        // Client
+        char client_path[UNIX_ADDRSTRLEN];
+        msg_t msg;
+        while(!Socket::is_listening(path, NULL, AF_UNIX));
+        Socket socket(path, NULL, AF_UNIX);
+        socket.get_path(client_path);
+        ASSERT_STREQ(client_path, path);
+        ASSERT_EQ(socket.get_peer_port(), 0);
+        // The server is running, its path can't be taken.
+        ASSERT_THROW(Socket(path, NULL, AF_UNIX, SOCK_STREAM, true), std::runtime_error);
+        ASSERT_EQ(errno, EADDRINUSE);
+        msg.number = 1;
+        strcpy(msg.text, "exit");
+        ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_STREQ(msg.text, "echo: exit");
+        socket.close();
+        exit(0);
+    }
+    // Host
+    struct sockaddr_un addr;
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    // Stale socket file, as left by a server that didn't exit cleanly.
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    ASSERT_EQ(bind(stale, (struct sockaddr*) &addr, sizeof(addr)), 0);
+    close(stale);
+    {
+        EchoServer server(path, NULL, false, AF_UNIX);
+        server.start();
+    }
+    while (wait(NULL) != -1);
+    EXPECT_EQ(access(path, F_OK), -1);
+}
+
+/// @brief Tested: Unix domain seqpacket sockets in the abstract namespace,
+///  which keep the boundaries of each message.
+TEST (ServerTest, UnixSeqpacket) {
+    const char* path = "@ipc_testing";
+    if (!fork()) {
+        // Client
+        char client_path[UNIX_ADDRSTRLEN];
+        msg_t msg;
+        while(!Socket::is_listening(path, NULL, AF_UNIX, SOCK_SEQPACKET));
+        Socket socket(path, NULL, AF_UNIX, SOCK_SEQPACKET);
+        socket.get_path(client_path);
+        ASSERT_STREQ(client_path, path);
+        msg.number = 1;
+        strcpy(msg.text, "first");
+        ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+        // A bigger buffer still gets a single message.
+        msg_t msgs[2];
+        ASSERT_EQ(socket.read(msgs, sizeof(msgs)), sizeof(msg_t));
+        ASSERT_STREQ(msgs[0].text, "echo: first");
+        strcpy(msg.text, "exit");
+        ASSERT_EQ(socket.write(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_EQ(socket.read(&msg, sizeof(msg_t)), sizeof(msg_t));
+        ASSERT_STREQ(msg.text, "echo: exit");
+        socket.close();
+        exit(0);
+    }
+    // Host
+    EchoServer server(path, NULL, false, AF_UNIX, SOCK_SEQPACKET);
+    server.start();
+    while (wait(NULL) != -1);
+}
+
+/// @brief Tested: A server with TCP Fast Open, and clients sending their first
+///  message with the connection.
+TEST (ServerTest, FastOpen) {
+    EchoServer server("localhost", "3000");
+    ASSERT_EQ(server.set_fastopen(), 0);
+    if (!fork()) {
+        // Client
+        msg_t msg;
+        while(!Socket::is_listening("localhost", "3000"));
+        for (int i = 0; i < 2; i++) {
+            Socket socket;
+            msg.number = i;
+            strcpy(msg.text, (i == 1) ? "exit" : "first");
+            ASSERT_EQ(socket.connect_fastopen("localhost", "3000", &msg, sizeof(msg_t)), sizeof(msg_t));
+            ASSERT_EQ(socket.read(&msg, sizeof(msg_t), MSG_WAITALL), sizeof(msg_t));
+            ASSERT_EQ(msg.number, i);
+            ASSERT_STREQ(msg.text, (i == 1) ? "echo: exit" : "echo: first");
+            socket.close();
+        }
+        exit(0);
+    }
+    // Host
+    server.start();
+    while (wait(NULL) != -1);
+}
+
+/// @brief Creates and destroys servers, for SignalRegistry.
+static void* create_servers(void* args) {
+    for (int i = 0; i < 200; i++) {
+        EchoServer server("localhost", "3002");
+    }
+    return NULL;
+}
+
+/// @brief Tested: Creating a server leaves the signal mask as it was, and
+///  SIGINT can arrive in any thread while servers come and go.
+TEST (ServerTest, SignalRegistry) {
+    sigset_t old_mask, mask;
+    Signal::block(SIGINT, &old_mask);
+    {
+        EchoServer server("localhost", "3002");
+    }
+    pthread_sigmask(SIG_SETMASK, NULL, &mask);
+    EXPECT_TRUE(sigismember(&mask, SIGINT));
+    Signal::restore_mask(&old_mask);
+    Thread creator(create_servers);
+    for (int i = 0; i < 200; i++) {
+        Signal::kill(getpid(), SIGINT);
+    }
+    creator.join();
+}
@@ -86,6 +86,20 @@ TEST_F(SignalTest, UnblockAll) {
     EXPECT_EQ(g_signal_value, SIGUSR1 + SIGUSR2 + SIGINT);
 }
 
+/// @brief Tested: Signal::block() with the previous mask, restore_mask().
+TEST_F(SignalTest, RestoreMask) {
+    sigset_t old_mask, mask;
+    Signal::block(SIGUSR2);
+    Signal::block(SIGUSR1, &old_mask);
+    EXPECT_TRUE(sigismember(&old_mask, SIGUSR2));
+    EXPECT_FALSE(sigismember(&old_mask, SIGUSR1));
+    EXPECT_EQ(Signal::restore_mask(&old_mask), 0);
+    pthread_sigmask(SIG_SETMASK, NULL, &mask);
+    EXPECT_FALSE(sigismember(&mask, SIGUSR1));
+    EXPECT_TRUE(sigismember(&mask, SIGUSR2));
+    Signal::unblock(SIGUSR2);
+}
+
 /// @brief Tested: Signal::ignore(), Signal::set_default_handler()
 TEST_F(SignalTest, IgnoreSignal) {
     Signal::ignore(SIGINT);
@@ -0,0 +1,287 @@
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <type_traits>
+#include "test_socket.h"
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: Socket::send_file() on a non-blocking socket, continuing
+///  after each partial write.
+TEST (SocketTest, SendFile) {
+    const size_t file_size = 8 * 1024 * 1024;
+    char path[] = "/tmp/ipc_send_file_XXXXXX";
+    std::vector<char> data(file_size), received(file_size);
+    size_t sent = 0, read = 0;
+    ssize_t aux;
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    unlink(path);
+    for (size_t i = 0; i < file_size; i++) {
+        data[i] = (char) (i * 7);
+    }
+    ASSERT_EQ(write(fd, data.data(), file_size), (ssize_t) file_size);
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    Socket *client = new Socket(), *server = new Socket();
+    connect_pair(listener, *client, *server);
+    ASSERT_EQ(server->set_nonblocking(), 0);
+    ASSERT_EQ(client->set_nonblocking(), 0);
+    while (read < file_size) {
+        if (sent < file_size && (aux = server->send_file(fd, sent, file_size - sent)) > 0) {
+            sent += aux;
+        }
+        if ( (aux = client->read(&received[read], file_size - read)) > 0) {
+            read += aux;
+        }
+    }
+    ASSERT_EQ(sent, file_size);
+    ASSERT_EQ(memcmp(data.data(), received.data(), file_size), 0);
+    // Past the end of the file.
+    ASSERT_EQ(server->send_file(fd, file_size, 10), 0);
+    delete client;
+    delete server;
+    close(fd);
+}
+
+/// @brief Tested: Relay between two connections, until the first one is
+///  closed.
+TEST (SocketTest, Relay) {
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 2), 0);
+    Socket *client_in = new Socket(), *server_in = new Socket();
+    Socket *client_out = new Socket(), *server_out = new Socket();
+    connect_pair(listener, *client_in, *server_in);
+    connect_pair(listener, *client_out, *server_out);
+    char text[16];
+    {
+        Relay relay(*server_in, *client_out, 4096);
+        ASSERT_EQ(client_in->write((void*) "hello", 6), 6);
+        ASSERT_EQ(relay.transfer(), 6);
+        ASSERT_EQ(relay.get_pending(), 0);
+        ASSERT_EQ(server_out->read(text, sizeof(text)), 6);
+        ASSERT_STREQ(text, "hello");
+        client_in->close();
+        ASSERT_EQ(relay.transfer(), 0);
+    }
+    delete client_in;
+    delete server_in;
+    delete client_out;
+    delete server_out;
+}
+
+static void count_completions(uint32_t first, uint32_t last, bool copied, void* args) {
+    *(uint32_t*) args += last - first + 1;
+}
+
+/// @brief Tested: Socket::write() with zero-copy sends, and their completions
+///  with Socket::poll_completions(). Short writes are copied.
+TEST (SocketTest, ZeroCopy) {
+    const int len = 64 * 1024;
+    std::vector<char> data(len, 'z'), received(len);
+    uint32_t completed = 0;
+    int read;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    Socket *client = new Socket(), *server = new Socket();
+    connect_pair(listener, *client, *server);
+    ASSERT_EQ(server->set_zerocopy(true, 4096), 0);
+    ASSERT_EQ(server->write((void*) "short", 6), 6);
+    ASSERT_EQ(server->get_zerocopy_id(), 0);
+    ASSERT_EQ(server->write(data.data(), len), len);
+    ASSERT_GT(server->get_zerocopy_id(), 0);
+    ASSERT_EQ(client->read(received.data(), 6), 6);
+    for (read = 0; read < len; ) {
+        read += client->read(&received[read], len - read);
+    }
+    ASSERT_EQ(memcmp(data.data(), received.data(), len), 0);
+    while (server->get_zerocopy_pending() > 0) {
+        ASSERT_GE(server->poll_completions(count_completions, &completed, 1000), 0);
+    }
+    ASSERT_EQ(completed, server->get_zerocopy_id());
+    ASSERT_EQ(server->poll_completions(), 0);
+    delete client;
+    delete server;
+}
+
+/// @brief Tested: Socket::connect() succeeds, and gives up at the deadline
+///  when the server never answers.
+TEST (SocketTest, ConnectTimeout) {
+    struct timespec start, end;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 0), 0);
+    Socket socket;
+    ASSERT_EQ(socket.connect("localhost", "3000", 1000), 0);
+    ASSERT_EQ(socket.get_peer_port(), 3000);
+    ASSERT_EQ(socket.connect("localhost", "3000", 1000), -1);
+    ASSERT_EQ(errno, EISCONN);
+    // Nobody accepts, so with the queue full the server drops the SYNs.
+    Socket unanswered;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_EQ(unanswered.connect("localhost", "3000", 200, AF_INET), -1);
+    ASSERT_EQ(errno, ETIMEDOUT);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ASSERT_LT((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000, 1000);
+    ASSERT_EQ(unanswered.get_sockfd(), -1);
+}
+
+/// @brief Tested: Socket::set_profile(), inherited by accepted sockets, and
+///  Socket::read() with busy polling.
+TEST (SocketTest, Profiles) {
+    int value;
+    socklen_t optlen = sizeof(value);
+    char data[8] = "profile", received[8];
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true, false, SOCKET_PROFILE_LATENCY);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    Socket *client = new Socket(), *server = new Socket();
+    connect_pair(listener, *client, *server);
+    ASSERT_EQ(getsockopt(server->get_sockfd(), IPPROTO_TCP, TCP_NODELAY, &value, &optlen), 0);
+    ASSERT_NE(value, 0);
+    server->inherit_profile(listener);
+    ASSERT_EQ(server->get_profile(), SOCKET_PROFILE_LATENCY);
+    // Throughput: corked until it's flushed.
+    ASSERT_EQ(client->set_profile(SOCKET_PROFILE_THROUGHPUT), 0);
+    ASSERT_EQ(client->get_profile(), SOCKET_PROFILE_THROUGHPUT);
+    ASSERT_EQ(getsockopt(client->get_sockfd(), IPPROTO_TCP, TCP_CORK, &value, &optlen), 0);
+    ASSERT_NE(value, 0);
+    ASSERT_EQ(client->write(data, 4), 4);
+    ASSERT_EQ(client->write(data + 4, 4), 4);
+    ASSERT_EQ(client->set_cork(false), 0);
+    // Busy polling, with the data already there and waiting for the rest.
+    ASSERT_EQ(server->set_busy_poll(-1), -1);
+    ASSERT_EQ(server->set_busy_poll(1000), 0);
+    ASSERT_EQ(server->read(received, 4, MSG_WAITALL), 4);
+    ASSERT_EQ(server->read(received + 4, 4, MSG_WAITALL), 4);
+    ASSERT_EQ(memcmp(data, received, sizeof(data)), 0);
+    ASSERT_EQ(client->set_profile(SOCKET_PROFILE_DEFAULT), 0);
+    ASSERT_EQ(client->write(data, sizeof(data)), sizeof(data));
+    ASSERT_EQ(server->read(received, sizeof(received), MSG_WAITALL), sizeof(received));
+    ASSERT_EQ(getsockopt(client->get_sockfd(), IPPROTO_TCP, TCP_CORK, &value, &optlen), 0);
+    ASSERT_EQ(value, 0);
+    delete client;
+    delete server;
+}
+
+/// @brief Tested: Sockets can be moved but not copied, and addresses are
+///  formatted on demand.
+TEST (SocketTest, MoveOnly) {
+    char ip[INET6_ADDRSTRLEN];
+    int value = 0, sockfd;
+    static_assert(!std::is_copy_constructible<Socket>::value, "Socket must not be copyable");
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    listener.get_peer_ip(ip);
+    ASSERT_STREQ(ip, "127.0.0.1");
+    Socket *client = new Socket(), *server = new Socket();
+    connect_pair(listener, *client, *server);
+    server->get_peer_ip(ip);
+    ASSERT_STREQ(ip, "127.0.0.1");
+    ASSERT_EQ(server->get_peer_port(), client->get_my_port());
+    ASSERT_EQ(server->get_my_port(), 3000);
+    sockfd = server->get_sockfd();
+    std::vector<Socket> sockets;
+    sockets.push_back(std::move(*server));
+    delete server;
+    ASSERT_EQ(sockets[0].get_sockfd(), sockfd);
+    ASSERT_EQ(sockets[0].get_my_port(), 3000);
+    // The descriptor was not closed by the moved-from socket.
+    ASSERT_EQ(client->write(&sockfd, sizeof(sockfd)), sizeof(sockfd));
+    ASSERT_EQ(sockets[0].read(&value, sizeof(value)), sizeof(value));
+    ASSERT_EQ(value, sockfd);
+    Socket other;
+    other = std::move(sockets[0]);
+    ASSERT_EQ(sockets[0].get_sockfd(), -1);
+    ASSERT_EQ(other.get_peer_port(), client->get_my_port());
+    delete client;
+}
+
+/// @brief Tested: Socket::connect_fastopen() sends the first message with the
+///  connection, with or without Fast Open enabled in the kernel, and fails
+///  when nobody listens.
+TEST (SocketTest, FastOpen) {
+    struct sockaddr_storage client_addr;
+    socklen_t addrlen;
+    char received[8];
+    int sockfd;
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listener.set_fastopen(5), 0);
+    ASSERT_EQ(listener.get_fastopen(), 5);
+    ASSERT_EQ(listen(listener.get_sockfd(), 2), 0);
+    // The first connection gets the cookie, if the server enables Fast Open.
+    for (int i = 0; i < 2; i++) {
+        Socket client;
+        ASSERT_EQ(client.connect_fastopen("localhost", "3000", "hello", 6, AF_INET), 6);
+        ASSERT_EQ(client.connect_fastopen("localhost", "3000", "hello", 6, AF_INET), -1);
+        ASSERT_EQ(errno, EISCONN);
+        ASSERT_EQ(client.get_peer_port(), 3000);
+        addrlen = sizeof(client_addr);
+        ASSERT_NE( (sockfd = accept(listener.get_sockfd(), (struct sockaddr*) &client_addr, &addrlen) ), -1);
+        Socket server;
+        ASSERT_EQ(server.init(sockfd, (struct sockaddr*) &client_addr, addrlen), 0);
+        ASSERT_EQ(server.read(received, sizeof(received)), 6);
+        ASSERT_STREQ(received, "hello");
+        ASSERT_EQ(server.write(received, 6), 6);
+        ASSERT_EQ(client.read(received, sizeof(received)), 6);
+    }
+    listener.close();
+    Socket refused;
+    ASSERT_EQ(refused.connect_fastopen("localhost", "3000", "hello", 6, AF_INET), -1);
+    ASSERT_EQ(refused.get_sockfd(), -1);
+}
+
+struct Timestamps {
+    uint32_t last_sent;
+    uint32_t last_acked;
+    int count;
+};
+
+static void count_timestamps(uint32_t id, int type, const struct timespec* ts, void* args) {
+    Timestamps* stamps = (Timestamps*) args;
+    ASSERT_GT(ts->tv_sec, 0);
+    if (type == SCM_TSTAMP_SND) {
+        stamps->last_sent = id;
+    } else if (type == SCM_TSTAMP_ACK) {
+        stamps->last_acked = id;
+    }
+    stamps->count++;
+}
+
+/// @brief Tested: Receive timestamps with Socket::read_timestamped(), and send
+///  timestamps with Socket::poll_completions().
+TEST (SocketTest, Timestamping) {
+    char data[100], received[200];
+    struct timespec ts, now;
+    Timestamps stamps = {0, 0, 0};
+    int read;
+    memset(data, 't', sizeof(data));
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    Socket *client = new Socket(), *server = new Socket();
+    connect_pair(listener, *client, *server);
+    ASSERT_EQ(server->set_timestamping(true, false), 0);
+    ASSERT_EQ(client->set_timestamping(false, true), 0);
+    // Receive timestamps are turned on asynchronously by the kernel.
+    ASSERT_EQ(client->write(data, 1), 1);
+    ASSERT_EQ(server->read_timestamped(received, 1, &ts), 1);
+    usleep(100000);
+    ASSERT_EQ(client->write(data, sizeof(data)), sizeof(data));
+    ASSERT_EQ(client->write(data, sizeof(data)), sizeof(data));
+    for (read = 0; read < 200; ) {
+        read += server->read_timestamped(received + read, sizeof(received) - read, &ts);
+        clock_gettime(CLOCK_REALTIME, &now);
+        ASSERT_GT(ts.tv_sec, 0);
+        ASSERT_LE(ts.tv_sec, now.tv_sec);
+        ASSERT_GE(ts.tv_sec, now.tv_sec - 5);
+    }
+    // IDs count bytes: the last one of each send, after the first one.
+    while (stamps.last_sent != 200 || stamps.last_acked != 200) {
+        ASSERT_GT(client->poll_completions(NULL, &stamps, 1000, count_timestamps), 0);
+    }
+    ASSERT_GE(stamps.count, 4);
+    delete client;
+    delete server;
+}
@@ -0,0 +1,70 @@
+#include "socket_pool.h"
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <unistd.h>
+#include "test_socket.h"
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: idle connections are reused, and closed connections are
+///  replaced on checkout.
+TEST (SocketPoolTest, Reuse) {
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 5), 0);
+    SocketPool pool;
+    Socket* first = pool.acquire("localhost", "3000", AF_INET);
+    ASSERT_NE(first, (Socket*) NULL);
+    Socket* server = new Socket();
+    accept_client(listener, *server);
+    pool.release(first);
+    ASSERT_EQ(pool.get_idle("localhost", "3000", AF_INET), 1);
+    Socket* second = pool.acquire("localhost", "3000", AF_INET);
+    ASSERT_EQ(second, first);
+    ASSERT_EQ(pool.get_idle("localhost", "3000", AF_INET), 0);
+    pool.release(second);
+    // The server closes the idle connection.
+    server->close();
+    delete server;
+    usleep(10000);
+    Socket* third = pool.acquire("localhost", "3000", AF_INET);
+    ASSERT_NE(third, (Socket*) NULL);
+    ASSERT_EQ(pool.get_total("localhost", "3000", AF_INET), 1);
+    server = new Socket();
+    accept_client(listener, *server);
+    ASSERT_EQ(third->write((void*) "ping", 5), 5);
+    char text[5];
+    ASSERT_EQ(server->read(text, 5), 5);
+    ASSERT_STREQ(text, "ping");
+    pool.release(third, false);
+    ASSERT_EQ(pool.get_total("localhost", "3000", AF_INET), 0);
+    delete server;
+}
+
+/// @brief Tested: caps on idle and total connections, and eviction of idle
+///  connections.
+TEST (SocketPoolTest, Limits) {
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 5), 0);
+    SocketPool pool(1, 2, 50);
+    Socket* first = pool.acquire("localhost", "3000", AF_INET);
+    Socket* second = pool.acquire("localhost", "3000", AF_INET);
+    ASSERT_NE(first, (Socket*) NULL);
+    ASSERT_NE(second, (Socket*) NULL);
+    ASSERT_EQ(pool.acquire("localhost", "3000", AF_INET), (Socket*) NULL);
+    ASSERT_EQ(errno, EAGAIN);
+    pool.release(first);
+    pool.release(second);
+    ASSERT_EQ(pool.get_idle("localhost", "3000", AF_INET), 1);
+    ASSERT_EQ(pool.get_total("localhost", "3000", AF_INET), 1);
+    usleep(100000);
+    ASSERT_EQ(pool.evict(), 1);
+    ASSERT_EQ(pool.get_total("localhost", "3000", AF_INET), 0);
+    // A NULL ip has its own bucket.
+    first = pool.acquire(NULL, "3000", AF_INET);
+    ASSERT_NE(first, (Socket*) NULL);
+    ASSERT_EQ(pool.get_total(NULL, "3000", AF_INET), 1);
+    ASSERT_EQ(pool.get_total("", "3000", AF_INET), 0);
+    pool.release(first, false);
+}
@@ -0,0 +1,91 @@
+#include "socket_stream.h"
+#include "socket.h"
+#include "gtest/gtest.h"
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "test_socket.h"
+
+/******************************************************************************
+ * Tests
+******************************************************************************/
+
+/// @brief Tested: buffered writes with operators, read_exact() and
+///  write_all().
+TEST (SocketStreamTest, ReadExactWriteAll) {
+    int i, value;
+    char c;
+    char text[16];
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    if (!fork()) {
+        // Client. Small writes are sent together.
+        Socket socket("localhost", "3000", AF_INET);
+        SocketStream stream(socket, 64, 256);
+        for (i=0; i<50; i++) {
+            stream << i;
+        }
+        ASSERT_EQ(stream.get_pending(), 200);
+        stream << 'c' << "hello";
+        ASSERT_EQ(stream.flush(), 0);
+        ASSERT_EQ(stream.get_pending(), 0);
+        ASSERT_EQ(stream.read_exact(text, 6), 6);
+        ASSERT_STREQ(text, "reply");
+        socket.close();
+        exit(0);
+    }
+    // Host. The read buffer is smaller than what was sent.
+    Socket client;
+    accept_client(listener, client);
+    SocketStream stream(client, 64);
+    for (i=0; i<50; i++) {
+        stream >> value;
+        ASSERT_EQ(value, i);
+    }
+    stream >> c;
+    ASSERT_EQ(c, 'c');
+    ASSERT_EQ(stream.read_exact(text, 6), 6);
+    ASSERT_STREQ(text, "hello");
+    ASSERT_EQ(stream.write_all("reply", 6), 6);
+    ASSERT_EQ(stream.read_exact(text, 1), 0);
+    client.close();
+    while (wait(NULL) != -1);
+}
+
+/// @brief Tested: read_until(), write_frame(), read_frame() and the flush
+///  threshold.
+TEST (SocketStreamTest, Frames) {
+    char frame[32];
+    Socket listener("localhost", "3000", AF_INET, SOCK_STREAM, true);
+    ASSERT_EQ(listen(listener.get_sockfd(), 1), 0);
+    if (!fork()) {
+        // Client
+        Socket socket("localhost", "3000", AF_INET);
+        SocketStream stream(socket, 64, 256, 16);
+        ASSERT_EQ(stream.write("first\nsecond\n\n", 14), 14);
+        ASSERT_EQ(stream.get_pending(), 14);
+        ASSERT_EQ(stream.write_frame("framed", 6), 6);
+        // Flushed when the threshold was reached.
+        ASSERT_LT(stream.get_pending(), 16);
+        ASSERT_EQ(stream.write_frame("", 0), 0);
+        ASSERT_EQ(stream.write_all("too long for the buffer\n", 24), 24);
+        socket.close();
+        exit(0);
+    }
+    // Host
+    Socket client;
+    accept_client(listener, client);
+    SocketStream stream(client, 64);
+    ASSERT_EQ(stream.read_until('\n', frame, sizeof(frame)), 5);
+    frame[5] = '\0';
+    ASSERT_STREQ(frame, "first");
+    ASSERT_EQ(stream.read_until('\n', frame, sizeof(frame)), 6);
+    ASSERT_EQ(stream.read_until('\n', frame, sizeof(frame)), 0);
+    ASSERT_EQ(stream.read_frame(frame, sizeof(frame)), 6);
+    ASSERT_EQ(memcmp(frame, "framed", 6), 0);
+    ASSERT_EQ(stream.read_frame(frame, sizeof(frame)), 0);
+    ASSERT_EQ(stream.read_until('\n', frame, 8), -1);
+    ASSERT_EQ(errno, EMSGSIZE);
+    client.close();
+    while (wait(NULL) != -1);
+}